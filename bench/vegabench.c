@@ -0,0 +1,560 @@
+/*
+    Vega Engine rendering benchmarks.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Runs synthetic backends headless and prints one JSON object per case to stdout.
+// Usage: vegabench [-p md|snes|gb] [-m pixel|line] [-n frames] [-s sprites] [-l planes] [-r rasterPercent] [-t threads] [-w thread|inline]
+// Every option left out is swept over its defaults, so running it with no arguments runs the whole suite. -w runs in window mode instead,
+// uncapped, presenting from the presentation thread or the video thread. Use it with SDL_VIDEODRIVER=dummy or offscreen.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define VEGA_VIDEO_BACKEND 1
+#include "../include/vega.h"
+
+#define BENCH_MAP_TILES 64 // Planes are BENCH_MAP_TILES by BENCH_MAP_TILES tiles.
+#define BENCH_MAP_SIZE (BENCH_MAP_TILES * 8)
+#define BENCH_MAX_PLANES 4
+#define BENCH_WARMUP_FRAMES 8
+
+typedef enum BenchCallback {
+    BENCH_CB_CLEARCOLOR,
+    BENCH_CB_PALETTECOLOR,
+    BENCH_CB_TILECOLOR,
+    BENCH_CB_PLANETILEID,
+    BENCH_CB_PLANETILEPRIORITY,
+    BENCH_CB_PLANETILEPALETTE,
+    BENCH_CB_PLANEHSCROLL,
+    BENCH_CB_PLANEVSCROLL,
+    BENCH_CB_PLANEHMOD,
+    BENCH_CB_PLANEVMOD,
+    BENCH_CB_PLANEENABLED,
+    BENCH_CB_PLANELINE,
+    BENCH_CB_PLANEHSCROLLTABLE,
+    BENCH_CB_PLANEVSCROLLTABLE,
+    BENCH_CB_SPRITECOLOR,
+    BENCH_CB_SPRITEATTRIB, // Priority, palette, position and size.
+    BENCH_CB_SPRITECHAIN, // Enabled, first, link and end.
+    BENCH_CB_LINESTART,
+    BENCH_CB_COUNT,
+} BenchCallback;
+
+static const char * benchCallbackNames[BENCH_CB_COUNT] = {
+    "getClearColor", "getPaletteColor", "getTileColor", "getPlaneTileID", "getPlaneTilePriority", "getPlaneTilePalette",
+    "getPlaneHScroll", "getPlaneVScroll", "getPlaneHMod", "getPlaneVMod", "getPlaneEnabled", "getPlaneLine",
+    "getPlaneHScrollTable", "getPlaneVScrollTable", "getSpriteColor", "getSpriteAttrib", "getSpriteChain", "lineStartCB",
+};
+
+typedef struct BenchCounters { // Callbacks may run on the render threads, so each thread counts into its own block.
+    u64 calls[BENCH_CB_COUNT];
+    struct BenchCounters * next;
+} BenchCounters;
+
+typedef struct BenchProfile {
+    const char * name;
+    u16 screenW;
+    u16 screenH;
+    u16 scanW;
+    u16 scanH;
+    VegaVideoIndexDepth colorIndexDepth;
+    VegaVideoIndexDepth paletteIndexDepth;
+    VegaVideoIndexDepth priorityIndexDepth;
+    u16 spriteCount;
+    u16 spriteLineLimit;
+    u8 planeCount;
+    u16 tileCount;
+    bool8 linkedSprites; // Walk the sprites through getSpriteFirst/getSpriteLink/getSpriteEnd like the MD's link table.
+} BenchProfile;
+
+typedef struct BenchSprite {
+    u16 x;
+    u16 y;
+    u16 w;
+    u16 h;
+    s8 dx;
+    s8 dy;
+    u16 tile;
+    u8 palette;
+    u8 priority;
+    u16 link;
+} BenchSprite;
+
+typedef struct BenchMapEntry {
+    u16 tile;
+    u8 palette;
+    u8 priority;
+} BenchMapEntry;
+
+typedef enum BenchMode {
+    BENCH_MODE_PIXEL, // Per-pixel plane callbacks.
+    BENCH_MODE_LINE, // getPlaneLine and the scroll tables.
+} BenchMode;
+
+static const char * benchModeNames[] = {"pixel", "line"};
+
+typedef enum BenchPresent {
+    BENCH_PRESENT_HEADLESS,
+    BENCH_PRESENT_THREAD,
+    BENCH_PRESENT_INLINE,
+} BenchPresent;
+
+static const char * benchPresentNames[] = {"headless", "thread", "inline"};
+
+static const BenchProfile benchProfiles[] = {
+    {"md", 320, 224, 420, 262, VEGA_INDDPTH_4, VEGA_INDDPTH_2, VEGA_INDDPTH_1, 80, 20, 2, 2048, true},
+    {"snes", 256, 224, 341, 262, VEGA_INDDPTH_4, VEGA_INDDPTH_3, VEGA_INDDPTH_2, 128, 32, 4, 1024, false},
+    {"gb", 160, 144, 228, 154, VEGA_INDDPTH_2, VEGA_INDDPTH_3, VEGA_INDDPTH_1, 40, 10, 2, 384, false},
+};
+
+static const u8 benchDefaultRaster[] = {0, 25, 100};
+
+static const BenchProfile * profile;
+static BenchMode benchMode;
+static u8 rasterPercent;
+static BenchPresent benchPresent;
+static u16 spriteCount;
+static u8 planeCount;
+static u32 rngState;
+static u8 * tiles = NULL;
+static BenchMapEntry * maps = NULL;
+static BenchSprite * sprites = NULL;
+static VegaVideoColor palettes[1 << 8][1 << 8];
+static u16 hScroll[BENCH_MAX_PLANES][1024]; // Per-row scroll, rewritten by the raster effects.
+static u16 vScroll[BENCH_MAX_PLANES];
+static u16 frameCount = 0;
+static BenchCounters * allCounters = NULL;
+static _Thread_local BenchCounters * localCounters = NULL;
+static pthread_mutex_t countersLock = PTHREAD_MUTEX_INITIALIZER;
+
+static BenchCounters * Bench_RegisterCounters() {
+    localCounters = calloc(1, sizeof(BenchCounters));
+    if (!localCounters) {
+        perror("bench counter allocation");
+        exit(1);
+    }
+    pthread_mutex_lock(&countersLock);
+    localCounters->next = allCounters;
+    allCounters = localCounters;
+    pthread_mutex_unlock(&countersLock);
+    return localCounters;
+}
+
+#define BENCH_COUNT(cb) ((localCounters ? localCounters : Bench_RegisterCounters())->calls[cb]++)
+
+static void Bench_ResetCounters() {
+    BenchCounters * c;
+    for (c = allCounters; c; c = c->next) {
+        memset(c->calls, 0, sizeof(c->calls));
+    }
+}
+
+static u64 Bench_SumCounter(BenchCallback cb) {
+    BenchCounters * c;
+    u64 sum = 0;
+    for (c = allCounters; c; c = c->next) {
+        sum += c->calls[cb];
+    }
+    return sum;
+}
+
+static u32 Bench_Rand() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static u64 Bench_GetTime() {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((u64)spec.tv_sec * 1000000000) + (u64)spec.tv_nsec;
+}
+
+static VegaVideoColor Bench_GetClearColor() {
+    BENCH_COUNT(BENCH_CB_CLEARCOLOR);
+    return 0x0843;
+}
+
+static VegaVideoColor Bench_GetPaletteColor(u8 palette, u8 color) {
+    BENCH_COUNT(BENCH_CB_PALETTECOLOR);
+    return palettes[palette][color];
+}
+
+static u8 Bench_GetTileColor(u16 tile, u8 x, u8 y) {
+    BENCH_COUNT(BENCH_CB_TILECOLOR);
+    return tiles[(tile * 64) + (y * 8) + x];
+}
+
+static inline const BenchMapEntry * Bench_GetMapEntry(u8 plane, u16 x, u16 y) {
+    return &maps[(plane * BENCH_MAP_TILES * BENCH_MAP_TILES) + (((y >> 3) % BENCH_MAP_TILES) * BENCH_MAP_TILES) + ((x >> 3) % BENCH_MAP_TILES)];
+}
+
+static u16 Bench_GetPlaneTileID(u8 plane, u16 x, u16 y) {
+    BENCH_COUNT(BENCH_CB_PLANETILEID);
+    return Bench_GetMapEntry(plane, x, y)->tile;
+}
+
+static u8 Bench_GetPlaneTilePriority(u8 plane, u16 x, u16 y) {
+    BENCH_COUNT(BENCH_CB_PLANETILEPRIORITY);
+    return Bench_GetMapEntry(plane, x, y)->priority;
+}
+
+static u8 Bench_GetPlaneTilePalette(u8 plane, u16 x, u16 y) {
+    BENCH_COUNT(BENCH_CB_PLANETILEPALETTE);
+    return Bench_GetMapEntry(plane, x, y)->palette;
+}
+
+static u16 Bench_GetPlaneHScroll(u8 plane, u16 row) {
+    BENCH_COUNT(BENCH_CB_PLANEHSCROLL);
+    return hScroll[plane][row];
+}
+
+static u16 Bench_GetPlaneVScroll(u8 plane, u16 col) {
+    BENCH_COUNT(BENCH_CB_PLANEVSCROLL);
+    return vScroll[plane];
+}
+
+static u16 Bench_GetPlaneHMod(u8 plane) {
+    BENCH_COUNT(BENCH_CB_PLANEHMOD);
+    return BENCH_MAP_SIZE;
+}
+
+static u16 Bench_GetPlaneVMod(u8 plane) {
+    BENCH_COUNT(BENCH_CB_PLANEVMOD);
+    return BENCH_MAP_SIZE;
+}
+
+static bool8 Bench_GetPlaneEnabled(u8 plane) {
+    BENCH_COUNT(BENCH_CB_PLANEENABLED);
+    return plane < planeCount;
+}
+
+static void Bench_GetPlaneLine(u8 plane, u16 line, u8 * colors, u8 * palettes, u8 * priorities) {
+    u32 col, x, y = (line - vScroll[plane]) % BENCH_MAP_SIZE;
+    const BenchMapEntry * entry;
+    BENCH_COUNT(BENCH_CB_PLANELINE);
+    for (col = 0; col < profile->screenW; col++) {
+        x = (col - hScroll[plane][line]) % BENCH_MAP_SIZE;
+        entry = Bench_GetMapEntry(plane, x, y);
+        colors[col] = tiles[(entry->tile * 64) + ((y & 7) * 8) + (x & 7)];
+        palettes[col] = entry->palette;
+        priorities[col] = entry->priority;
+    }
+}
+
+static void Bench_GetPlaneHScrollTable(u8 plane, u16 * rows) {
+    BENCH_COUNT(BENCH_CB_PLANEHSCROLLTABLE);
+    memcpy(rows, hScroll[plane], profile->screenH * sizeof(u16));
+}
+
+static void Bench_GetPlaneVScrollTable(u8 plane, u16 * cols) {
+    u32 col;
+    BENCH_COUNT(BENCH_CB_PLANEVSCROLLTABLE);
+    for (col = 0; col < profile->screenW; col++) {
+        cols[col] = vScroll[plane];
+    }
+}
+
+static u8 Bench_GetSpriteColor(u16 sprite, u16 x, u16 y) {
+    const BenchSprite * spr = &sprites[sprite];
+    BENCH_COUNT(BENCH_CB_SPRITECOLOR);
+    return tiles[((spr->tile + ((y >> 3) * (spr->w >> 3)) + (x >> 3)) % profile->tileCount * 64) + ((y & 7) * 8) + (x & 7)];
+}
+
+static u8 Bench_GetSpritePriority(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITEATTRIB);
+    return sprites[sprite].priority;
+}
+
+static u8 Bench_GetSpritePalette(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITEATTRIB);
+    return sprites[sprite].palette;
+}
+
+static u16 Bench_GetSpriteX(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITEATTRIB);
+    return sprites[sprite].x;
+}
+
+static u16 Bench_GetSpriteY(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITEATTRIB);
+    return sprites[sprite].y;
+}
+
+static u16 Bench_GetSpriteW(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITEATTRIB);
+    return sprites[sprite].w;
+}
+
+static u16 Bench_GetSpriteH(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITEATTRIB);
+    return sprites[sprite].h;
+}
+
+static bool8 Bench_GetSpriteEnabled(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITECHAIN);
+    return sprite < spriteCount;
+}
+
+static u16 Bench_GetSpriteFirst() {
+    BENCH_COUNT(BENCH_CB_SPRITECHAIN);
+    return 0;
+}
+
+static u16 Bench_GetSpriteLink(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITECHAIN);
+    return sprites[sprite].link;
+}
+
+static bool8 Bench_GetSpriteEnd(u16 sprite) {
+    BENCH_COUNT(BENCH_CB_SPRITECHAIN);
+    return sprites[sprite].link == 0;
+}
+
+static void Bench_FrameStart() {
+    u16 i;
+    BenchSprite * spr;
+    frameCount++;
+    for (i = 0; i < spriteCount; i++) { // Every sprite moves every frame, bouncing off the screen edges.
+        spr = &sprites[i];
+        if ((s32)spr->x + spr->dx < 0 || (s32)spr->x + spr->dx + spr->w > profile->screenW) spr->dx = -spr->dx;
+        if ((s32)spr->y + spr->dy < 0 || (s32)spr->y + spr->dy + spr->h > profile->screenH) spr->dy = -spr->dy;
+        spr->x += spr->dx;
+        spr->y += spr->dy;
+        Vega_VideoUpdateSpriteCache(i);
+    }
+}
+
+static void Bench_LineStart(u16 line) {
+    u8 plane;
+    u16 color;
+    BENCH_COUNT(BENCH_CB_LINESTART);
+    if (line >= profile->screenH || ((line * 37u + frameCount) % 100) >= rasterPercent) return;
+    // A raster effect: a line scroll split on every plane and a palette write, the way a wavy water line or sky gradient would do it.
+    for (plane = 0; plane < planeCount; plane++) {
+        hScroll[plane][line] = (u16)(frameCount + (line >> 2) * (plane + 1));
+        if (benchMode == BENCH_MODE_LINE) Vega_VideoUpdatePlaneCache(plane);
+    }
+    color = 1 + ((line + frameCount) % ((1 << profile->colorIndexDepth) - 1)); // Color 0 stays transparent.
+    palettes[0][color] = (VegaVideoColor)((line << 6) | 1);
+    Vega_VideoUpdatePaletteCache(0);
+}
+
+static void Bench_Generate() {
+    u32 i, p, c, tileCount = profile->tileCount;
+    rngState = 0x1234567;
+    tiles = malloc(tileCount * 64);
+    maps = malloc(BENCH_MAX_PLANES * BENCH_MAP_TILES * BENCH_MAP_TILES * sizeof(BenchMapEntry));
+    sprites = calloc(spriteCount ? spriteCount : 1, sizeof(BenchSprite));
+    if (!tiles || !maps || !sprites) {
+        perror("bench data allocation");
+        exit(1);
+    }
+    for (i = 0; i < tileCount * 64; i++) {
+        tiles[i] = (Bench_Rand() % 5) ? Bench_Rand() & ((1 << profile->colorIndexDepth) - 1) : 0; // Roughly a fifth of each tile is transparent.
+    }
+    for (i = 0; i < BENCH_MAX_PLANES * BENCH_MAP_TILES * BENCH_MAP_TILES; i++) {
+        maps[i].tile = Bench_Rand() % tileCount;
+        maps[i].palette = Bench_Rand() & ((1 << profile->paletteIndexDepth) - 1);
+        maps[i].priority = Bench_Rand() & ((1 << profile->priorityIndexDepth) - 1);
+    }
+    for (p = 0; p < (1u << profile->paletteIndexDepth); p++) {
+        for (c = 0; c < (1u << profile->colorIndexDepth); c++) {
+            palettes[p][c] = c ? (VegaVideoColor)((Bench_Rand() & 0xFFFE) | 1) : 0;
+        }
+    }
+    for (p = 0; p < BENCH_MAX_PLANES; p++) {
+        for (i = 0; i < 1024; i++) {
+            hScroll[p][i] = (u16)(p * 24);
+        }
+        vScroll[p] = (u16)(p * 16);
+    }
+    for (i = 0; i < spriteCount; i++) {
+        sprites[i].w = 8 << (Bench_Rand() % (2 + (profile->screenW > 160)));
+        sprites[i].h = 8 << (Bench_Rand() % (2 + (profile->screenW > 160)));
+        sprites[i].x = Bench_Rand() % (profile->screenW - sprites[i].w);
+        sprites[i].y = Bench_Rand() % (profile->screenH - sprites[i].h);
+        sprites[i].dx = (s8)((Bench_Rand() % 5) - 2);
+        sprites[i].dy = (s8)((Bench_Rand() % 5) - 2);
+        sprites[i].tile = Bench_Rand() % tileCount;
+        sprites[i].palette = Bench_Rand() & ((1 << profile->paletteIndexDepth) - 1);
+        sprites[i].priority = Bench_Rand() & ((1 << profile->priorityIndexDepth) - 1);
+        sprites[i].link = (i + 1) % spriteCount;
+    }
+    frameCount = 0;
+}
+
+static void Bench_Free() {
+    free(tiles);
+    free(maps);
+    free(sprites);
+    tiles = NULL;
+    maps = NULL;
+    sprites = NULL;
+}
+
+static void Bench_Run(u32 frames, u8 threads) {
+    VegaVideoBackend backend = {0};
+    u64 start, elapsed;
+    u32 cb;
+    double frameNs;
+    Bench_Generate();
+    backend.screenW = profile->screenW;
+    backend.screenH = profile->screenH;
+    backend.scanW = profile->scanW;
+    backend.scanH = profile->scanH;
+    backend.colorIndexDepth = profile->colorIndexDepth;
+    backend.paletteIndexDepth = profile->paletteIndexDepth;
+    backend.priorityIndexDepth = profile->priorityIndexDepth;
+    backend.spriteCount = spriteCount;
+    backend.spriteLineLimit = profile->spriteLineLimit;
+    backend.planeCount = planeCount;
+    backend.tileCount = profile->tileCount;
+    backend.getClearColor = Bench_GetClearColor;
+    backend.getPaletteColor = Bench_GetPaletteColor;
+    backend.getTileColor = Bench_GetTileColor;
+    backend.getPlaneTileID = Bench_GetPlaneTileID;
+    backend.getPlaneTilePriority = Bench_GetPlaneTilePriority;
+    backend.getPlaneTilePalette = Bench_GetPlaneTilePalette;
+    backend.getPlaneHScroll = Bench_GetPlaneHScroll;
+    backend.getPlaneVScroll = Bench_GetPlaneVScroll;
+    backend.getPlaneHMod = Bench_GetPlaneHMod;
+    backend.getPlaneVMod = Bench_GetPlaneVMod;
+    backend.getPlaneEnabled = Bench_GetPlaneEnabled;
+    if (benchMode == BENCH_MODE_LINE) {
+        backend.getPlaneLine = Bench_GetPlaneLine;
+        backend.getPlaneHScrollTable = Bench_GetPlaneHScrollTable;
+        backend.getPlaneVScrollTable = Bench_GetPlaneVScrollTable;
+    }
+    backend.getSpriteColor = Bench_GetSpriteColor;
+    backend.getSpritePriority = Bench_GetSpritePriority;
+    backend.getSpritePalette = Bench_GetSpritePalette;
+    backend.getSpriteX = Bench_GetSpriteX;
+    backend.getSpriteY = Bench_GetSpriteY;
+    backend.getSpriteW = Bench_GetSpriteW;
+    backend.getSpriteH = Bench_GetSpriteH;
+    backend.getSpriteEnabled = Bench_GetSpriteEnabled;
+    if (profile->linkedSprites) {
+        backend.getSpriteFirst = Bench_GetSpriteFirst;
+        backend.getSpriteLink = Bench_GetSpriteLink;
+        backend.getSpriteEnd = Bench_GetSpriteEnd;
+    }
+    backend.frameStartCB = Bench_FrameStart;
+    backend.lineStartCB = Bench_LineStart;
+
+    Vega_VideoSetPresentThread(benchPresent != BENCH_PRESENT_INLINE);
+    Vega_VideoInitMode(backend, (benchPresent == BENCH_PRESENT_HEADLESS) ? VEGA_VIDMODE_HEADLESS : VEGA_VIDMODE_WINDOW);
+    Vega_VideoSetRefreshRate(0);
+    if (threads) Vega_VideoSetRenderThreads(threads, 0);
+    Vega_VideoRunFrames(BENCH_WARMUP_FRAMES);
+    Bench_ResetCounters();
+    start = Bench_GetTime();
+    Vega_VideoRunFrames(frames);
+    elapsed = Bench_GetTime() - start;
+    Vega_VideoDeinit();
+
+    frameNs = (double)elapsed / frames;
+    printf("{\"profile\":\"%s\",\"mode\":\"%s\",\"present\":\"%s\",\"sprites\":%u,\"planes\":%u,\"raster\":%u,\"threads\":%u,\"frames\":%u,",
+        profile->name, benchModeNames[benchMode], benchPresentNames[benchPresent], spriteCount, planeCount, rasterPercent, threads, frames);
+    printf("\"nsPerFrame\":%.0f,\"nsPerLine\":%.1f,\"fps\":%.2f,\"callsPerFrame\":{", frameNs, frameNs / profile->screenH, 1000000000.0 / frameNs);
+    for (cb = 0; cb < BENCH_CB_COUNT; cb++) {
+        printf("%s\"%s\":%.1f", cb ? "," : "", benchCallbackNames[cb], (double)Bench_SumCounter(cb) / frames);
+    }
+    printf("}}\n");
+    fflush(stdout);
+    Bench_Free();
+}
+
+static void Bench_Usage(const char * name) {
+    fprintf(stderr, "usage: %s [-p md|snes|gb] [-m pixel|line] [-n frames] [-s sprites] [-l planes] [-r rasterPercent] [-t threads] [-w thread|inline]\n", name);
+    exit(2);
+}
+
+int main(int argc, char ** argv) {
+    const BenchProfile * onlyProfile = NULL;
+    s32 onlyMode = -1, onlySprites = -1, onlyPlanes = -1, onlyRaster = -1;
+    u32 frames = 120, i, p, m, r;
+    u8 threads = 0;
+    for (i = 1; i < (u32)argc; i++) {
+        if (argv[i][0] != '-' || !argv[i][1] || argv[i][2] || i + 1 >= (u32)argc) Bench_Usage(argv[0]);
+        const char * arg = argv[++i];
+        switch (argv[i-1][1]) {
+            case 'p':
+                for (p = 0; p < sizeof(benchProfiles) / sizeof(BenchProfile); p++) {
+                    if (!strcmp(arg, benchProfiles[p].name)) onlyProfile = &benchProfiles[p];
+                }
+                if (!onlyProfile) Bench_Usage(argv[0]);
+                break;
+            case 'm':
+                if (!strcmp(arg, "pixel")) onlyMode = BENCH_MODE_PIXEL;
+                else if (!strcmp(arg, "line")) onlyMode = BENCH_MODE_LINE;
+                else Bench_Usage(argv[0]);
+                break;
+            case 'n':
+                frames = (u32)atoi(arg);
+                if (!frames) Bench_Usage(argv[0]);
+                break;
+            case 's':
+                onlySprites = atoi(arg);
+                break;
+            case 'l':
+                onlyPlanes = atoi(arg);
+                if (onlyPlanes > BENCH_MAX_PLANES) onlyPlanes = BENCH_MAX_PLANES;
+                break;
+            case 'r':
+                onlyRaster = atoi(arg);
+                if (onlyRaster > 100) onlyRaster = 100;
+                break;
+            case 't':
+                threads = (u8)atoi(arg);
+                break;
+            case 'w':
+                if (!strcmp(arg, "thread")) benchPresent = BENCH_PRESENT_THREAD;
+                else if (!strcmp(arg, "inline")) benchPresent = BENCH_PRESENT_INLINE;
+                else Bench_Usage(argv[0]);
+                break;
+            default:
+                Bench_Usage(argv[0]);
+        }
+    }
+    for (p = 0; p < sizeof(benchProfiles) / sizeof(BenchProfile); p++) {
+        profile = &benchProfiles[p];
+        if (onlyProfile && profile != onlyProfile) continue;
+        spriteCount = (onlySprites >= 0) ? (u16)onlySprites : profile->spriteCount;
+        planeCount = (onlyPlanes >= 0) ? (u8)onlyPlanes : profile->planeCount;
+        for (m = BENCH_MODE_PIXEL; m <= BENCH_MODE_LINE; m++) {
+            if (onlyMode >= 0 && (s32)m != onlyMode) continue;
+            benchMode = (BenchMode)m;
+            for (r = 0; r < sizeof(benchDefaultRaster); r++) {
+                rasterPercent = (onlyRaster >= 0) ? (u8)onlyRaster : benchDefaultRaster[r];
+                Bench_Run(frames, threads);
+                if (onlyRaster >= 0) break;
+            }
+        }
+    }
+    return 0;
+}
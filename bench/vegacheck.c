@@ -0,0 +1,151 @@
+/*
+    Vega Engine self-checks.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Runs small headless scenarios against the engine and checks what they observe. Prints one line per check and exits with 1 if any failed.
+// Usage: vegacheck
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VEGA_VIDEO_BACKEND 1
+#include "../include/vega.h"
+
+#define CHECK_SCREEN_W 64
+#define CHECK_SCREEN_H 32
+#define CHECK_BUS_ADDR 0x10
+#define CHECK_BUS_VALUE 0x5A
+#define CHECK_RING_SIZE 4
+#define CHECK_RING_WRITES 10
+
+static u32 failures = 0;
+static VegaContext * checkContext = NULL;
+static u8 checkRam[256];
+static u32 checkCalls, checkMisses; // Updated from the render threads.
+static u32 checkWrites[CHECK_RING_WRITES];
+static u32 checkWriteCount;
+
+static void Check_Report(bool8 ok, const char * name) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+    failures += !ok;
+}
+
+static VegaVideoColor Check_GetClearColor() { return 0x0001; }
+static VegaVideoColor Check_GetPaletteColor(u8 palette, u8 color) { return color ? (VegaVideoColor)((color << 1) | 1) : 0; }
+static u8 Check_GetTileColor(u16 tile, u8 x, u8 y) { return (u8)((x + y + tile) & 15); }
+static u8 Check_GetPlaneTilePriority(u8 plane, u16 x, u16 y) { return 0; }
+static u8 Check_GetPlaneTilePalette(u8 plane, u16 x, u16 y) { return 0; }
+static u16 Check_GetPlaneHScroll(u8 plane, u16 row) { return 0; }
+static u16 Check_GetPlaneVScroll(u8 plane, u16 col) { return 0; }
+static u16 Check_GetPlaneMod(u8 plane) { return 256; }
+static u8 Check_GetSpriteColor(u16 sprite, u16 x, u16 y) { return 0; }
+static u8 Check_GetSpriteByte(u16 sprite) { return 0; }
+static u16 Check_GetSpriteWord(u16 sprite) { return 0; }
+
+static u16 Check_GetPlaneTileIDInContext(u8 plane, u16 x, u16 y) { // Runs on the render threads, which must see the context that started them.
+    __atomic_add_fetch(&checkCalls, 1, __ATOMIC_RELAXED);
+    if (Vega_ContextGetCurrent() != checkContext || Vega_IOBusRead8(CHECK_BUS_ADDR) != CHECK_BUS_VALUE) __atomic_add_fetch(&checkMisses, 1, __ATOMIC_RELAXED);
+    return (u16)(x >> 3);
+}
+
+static VegaVideoBackend Check_Backend() {
+    VegaVideoBackend backend = {0};
+    backend.screenW = CHECK_SCREEN_W;
+    backend.screenH = CHECK_SCREEN_H;
+    backend.scanW = CHECK_SCREEN_W + 16;
+    backend.scanH = CHECK_SCREEN_H + 8;
+    backend.colorIndexDepth = VEGA_INDDPTH_4;
+    backend.paletteIndexDepth = VEGA_INDDPTH_2;
+    backend.priorityIndexDepth = VEGA_INDDPTH_1;
+    backend.planeCount = 1;
+    backend.tileCount = 16;
+    backend.getClearColor = Check_GetClearColor;
+    backend.getPaletteColor = Check_GetPaletteColor;
+    backend.getTileColor = Check_GetTileColor;
+    backend.getPlaneTileID = Check_GetPlaneTileIDInContext;
+    backend.getPlaneTilePriority = Check_GetPlaneTilePriority;
+    backend.getPlaneTilePalette = Check_GetPlaneTilePalette;
+    backend.getPlaneHScroll = Check_GetPlaneHScroll;
+    backend.getPlaneVScroll = Check_GetPlaneVScroll;
+    backend.getPlaneHMod = Check_GetPlaneMod;
+    backend.getPlaneVMod = Check_GetPlaneMod;
+    backend.getSpriteColor = Check_GetSpriteColor;
+    backend.getSpritePriority = Check_GetSpriteByte;
+    backend.getSpritePalette = Check_GetSpriteByte;
+    backend.getSpriteX = Check_GetSpriteWord;
+    backend.getSpriteY = Check_GetSpriteWord;
+    backend.getSpriteW = Check_GetSpriteWord;
+    backend.getSpriteH = Check_GetSpriteWord;
+    return backend;
+}
+
+static void Check_RenderThreadContext() {
+    bool8 started;
+    checkContext = Vega_ContextCreate();
+    if (!checkContext) {
+        Check_Report(false, "render threads run in the owning context");
+        return;
+    }
+    Vega_ContextMakeCurrent(checkContext);
+    checkRam[CHECK_BUS_ADDR] = CHECK_BUS_VALUE;
+    Vega_IOBusInit(16, 8, false);
+    Vega_IOBusMap(VegaBusMemDef(0, sizeof(checkRam), checkRam, 0, false));
+    Vega_VideoInitMode(Check_Backend(), VEGA_VIDMODE_HEADLESS);
+    started = Vega_VideoSetRenderThreads(2, 4);
+    checkCalls = checkMisses = 0;
+    Vega_VideoRunFrames(2);
+    Vega_VideoDeinit();
+    Vega_IOBusDeinit();
+    Vega_ContextMakeCurrent(NULL);
+    Vega_ContextDestroy(checkContext);
+    checkContext = NULL;
+    Check_Report(started && checkCalls && !checkMisses, "render threads run in the owning context");
+}
+
+static void Check_RecordWrite(u32 val, VegaAccessSize size) {
+    if (checkWriteCount < CHECK_RING_WRITES) checkWrites[checkWriteCount] = val;
+    checkWriteCount++;
+}
+
+static void Check_FullRingOnConsumer() { // The thread that drains the queue also fills it, so waiting for room would never end.
+    VegaRegister reg = VegaRegDef(4, NULL, Check_RecordWrite, NULL);
+    u32 i;
+    bool8 ordered = true;
+    Vega_IOInit(&reg, 1);
+    Vega_IOSetAsync(CHECK_RING_SIZE);
+    checkWriteCount = 0;
+    Vega_IOSetTime(100);
+    Vega_IODrain(0);
+    for (i = 0; i < CHECK_RING_WRITES; i++) Vega_IORegWrite(0, i, ACCESS_LONG);
+    Vega_IODrain(UINT64_MAX);
+    for (i = 0; i < CHECK_RING_WRITES; i++) ordered &= checkWrites[i] == i;
+    Vega_IODeinit();
+    Check_Report(checkWriteCount == CHECK_RING_WRITES && ordered, "a full queue filled by its consumer runs its oldest writes");
+}
+
+int main() {
+    Check_RenderThreadContext();
+    Check_FullRingOnConsumer();
+    return failures ? 1 : 0;
+}
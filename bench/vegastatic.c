@@ -0,0 +1,206 @@
+/*
+    Vega Engine static backend benchmark.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// Runs the backend in bench/vegastatic.h headless and prints the FNV-1a hash of every frame it rendered and the frame rate.
+// Usage: vegastatic [frames]
+// Built against bin/libvega.so it measures the generic renderer, linked with -flto against bin/libvega-static.a made for the same
+// header it measures the specialized one. The hashes must match.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define VEGA_VIDEO_BACKEND 1
+#include "../include/vega.h"
+#include "vegastatic.h"
+
+#define STATIC_DEFAULT_FRAMES 600
+
+u8 staticTiles[STATIC_TILES][8][8];
+u16 staticMaps[STATIC_PLANES][STATIC_MAP_H][STATIC_MAP_W];
+StaticSprite staticSprites[STATIC_SPRITES];
+u16 staticFrame = 0;
+
+static VegaVideoColor palettes[4][16];
+static u16 hScroll[STATIC_PLANES][STATIC_SCREEN_H];
+static u32 rngState = 1;
+static u64 frameHash = 0xCBF29CE484222325ull;
+
+static u32 Static_Rand() {
+    rngState = rngState * 1103515245 + 12345;
+    return rngState >> 8;
+}
+
+static u64 Static_GetTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static VegaVideoColor Static_GetClearColor() {
+    return palettes[0][0];
+}
+
+static VegaVideoColor Static_GetPaletteColor(u8 palette, u8 color) {
+    return palettes[palette & 3][color & 15];
+}
+
+static u16 Static_GetPlaneHScroll(u8 plane, u16 row) {
+    return hScroll[plane][row % STATIC_SCREEN_H];
+}
+
+static u16 Static_GetPlaneHMod(u8 plane) {
+    return STATIC_MAP_W * 8;
+}
+
+static u16 Static_GetPlaneVMod(u8 plane) {
+    return STATIC_MAP_H * 8;
+}
+
+static u8 Static_GetSpritePriority(u16 sprite) {
+    return staticSprites[sprite].priority;
+}
+
+static u8 Static_GetSpritePalette(u16 sprite) {
+    return staticSprites[sprite].palette;
+}
+
+static u16 Static_GetSpriteX(u16 sprite) {
+    return staticSprites[sprite].x;
+}
+
+static u16 Static_GetSpriteY(u16 sprite) {
+    return staticSprites[sprite].y;
+}
+
+static u16 Static_GetSpriteW(u16 sprite) {
+    return staticSprites[sprite].w;
+}
+
+static u16 Static_GetSpriteH(u16 sprite) {
+    return staticSprites[sprite].h;
+}
+
+static void Static_LineStart(u16 line) { // Line scroll on both planes and a mid-frame palette change.
+    if (line < STATIC_SCREEN_H) {
+        hScroll[0][line] = (u16)(staticFrame * 2 + line / 4);
+        hScroll[1][line] = staticFrame;
+    }
+    if (line == STATIC_SCREEN_H / 2) {
+        palettes[1][3] ^= 0x0840;
+        Vega_VideoUpdatePaletteCache(1);
+    }
+}
+
+static void Static_FrameStart() {
+    u16 i;
+    staticFrame++;
+    for (i = 0; i < STATIC_SPRITES; i++) {
+        staticSprites[i].x = (u16)((i * 37 + staticFrame * 3) % (STATIC_SCREEN_W + 32));
+        staticSprites[i].y = (u16)((i * 53 + staticFrame) % (STATIC_SCREEN_H + 32));
+        Vega_VideoUpdateSpriteCache(i);
+    }
+}
+
+static void Static_HashFrame(const VegaVideoColor * pixels, u16 w, u16 h, u32 pitch) {
+    u16 x, y;
+    const VegaVideoColor * row;
+    for (y = 0; y < h; y++) {
+        row = (const VegaVideoColor *)((const u8 *)pixels + y * pitch);
+        for (x = 0; x < w; x++) frameHash = (frameHash ^ row[x]) * 0x100000001B3ull;
+    }
+}
+
+static void Static_Fill() {
+    u32 tile, plane, x, y, i;
+    for (tile = 0; tile < STATIC_TILES; tile++) {
+        for (y = 0; y < 8; y++) {
+            for (x = 0; x < 8; x++) staticTiles[tile][y][x] = Static_Rand() & 15;
+        }
+    }
+    for (plane = 0; plane < STATIC_PLANES; plane++) {
+        for (y = 0; y < STATIC_MAP_H; y++) {
+            for (x = 0; x < STATIC_MAP_W; x++) staticMaps[plane][y][x] = (u16)Static_Rand();
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        for (x = 0; x < 16; x++) palettes[i][x] = (VegaVideoColor)(Static_Rand() & 0xFFFE);
+    }
+    for (i = 0; i < STATIC_SPRITES; i++) {
+        staticSprites[i].w = (u16)(8 * (1 + i % 4));
+        staticSprites[i].h = (u16)(8 * (1 + (i / 4) % 4));
+        staticSprites[i].palette = i & 3;
+        staticSprites[i].priority = i & 1;
+        staticSprites[i].tile = (u16)(i * 16);
+    }
+}
+
+static VegaVideoBackend Static_Backend() { // The constants and callbacks the header specializes must match it, or init fails in the static build.
+    VegaVideoBackend backend = {0};
+    backend.screenW = STATIC_SCREEN_W;
+    backend.screenH = STATIC_SCREEN_H;
+    backend.scanW = 420;
+    backend.scanH = 262;
+    backend.colorIndexDepth = VEGA_INDDPTH_4;
+    backend.paletteIndexDepth = VEGA_INDDPTH_2;
+    backend.priorityIndexDepth = VEGA_INDDPTH_1;
+    backend.spriteCount = STATIC_SPRITES;
+    backend.planeCount = STATIC_PLANES;
+    backend.getClearColor = Static_GetClearColor;
+    backend.getPaletteColor = Static_GetPaletteColor;
+    backend.getTileColor = Static_GetTileColor;
+    backend.getPlaneTileID = Static_GetPlaneTileID;
+    backend.getPlaneTilePriority = Static_GetPlaneTilePriority;
+    backend.getPlaneTilePalette = Static_GetPlaneTilePalette;
+    backend.getPlaneHScroll = Static_GetPlaneHScroll;
+    backend.getPlaneVScroll = Static_GetPlaneVScroll;
+    backend.getPlaneHMod = Static_GetPlaneHMod;
+    backend.getPlaneVMod = Static_GetPlaneVMod;
+    backend.getSpriteColor = Static_GetSpriteColor;
+    backend.getSpritePriority = Static_GetSpritePriority;
+    backend.getSpritePalette = Static_GetSpritePalette;
+    backend.getSpriteX = Static_GetSpriteX;
+    backend.getSpriteY = Static_GetSpriteY;
+    backend.getSpriteW = Static_GetSpriteW;
+    backend.getSpriteH = Static_GetSpriteH;
+    backend.shouldBlankPixel = Static_ShouldBlankPixel;
+    backend.lineStartCB = Static_LineStart;
+    backend.frameStartCB = Static_FrameStart;
+    return backend;
+}
+
+int main(int argc, char ** argv) {
+    u32 frames = argc > 1 ? (u32)atoi(argv[1]) : STATIC_DEFAULT_FRAMES;
+    u64 start, elapsed;
+    if (!frames) frames = STATIC_DEFAULT_FRAMES; // Vega_VideoRunFrames(0) would never return.
+    Static_Fill();
+    Vega_VideoInitMode(Static_Backend(), VEGA_VIDMODE_HEADLESS);
+    Vega_VideoSetFrameCB(Static_HashFrame);
+    start = Static_GetTime();
+    Vega_VideoRunFrames(frames);
+    elapsed = Static_GetTime() - start;
+    Vega_VideoDeinit();
+    printf("hash %016llx fps %.1f\n", (unsigned long long)frameHash, elapsed ? frames * 1e9 / (double)elapsed : 0.0);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+    Vega Engine example static backend.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+// A synthetic two-plane backend written for the static build, see src/vegabackend.h. bench/vegastatic.c defines the data and
+// drives it; make static-bench builds it once against bin/libvega.so and once against bin/libvega-static.a specialized for this
+// header, and checks both render the same frames.
+
+#ifndef VEGA_STATIC_EXAMPLE_H
+#define VEGA_STATIC_EXAMPLE_H 1
+
+#include "../include/vegatypes.h"
+#include "../include/vegavideo.h"
+
+#define STATIC_SCREEN_W 320
+#define STATIC_SCREEN_H 224
+#define STATIC_PLANES 2
+#define STATIC_TILES 2048
+#define STATIC_MAP_W 64 // Planes are STATIC_MAP_W by STATIC_MAP_H tiles.
+#define STATIC_MAP_H 32
+#define STATIC_SPRITES 80
+
+typedef struct StaticSprite {
+    u16 x, y, w, h;
+    u8 palette, priority;
+    u16 tile; // First of the sprite's (w/8)*(h/8) tiles, in rows.
+} StaticSprite;
+
+extern u8 staticTiles[STATIC_TILES][8][8];
+extern u16 staticMaps[STATIC_PLANES][STATIC_MAP_H][STATIC_MAP_W]; // Priority in bit 15, palette in bits 13-14, tile in bits 0-10.
+extern StaticSprite staticSprites[STATIC_SPRITES];
+extern u16 staticFrame;
+
+static inline u16 Static_GetMapEntry(u8 plane, u16 x, u16 y) {
+    return staticMaps[plane][(y >> 3) % STATIC_MAP_H][(x >> 3) % STATIC_MAP_W];
+}
+
+static inline u8 Static_GetTileColor(u16 tile, u8 x, u8 y) {
+    return staticTiles[tile % STATIC_TILES][y & 7][x & 7];
+}
+
+static inline u16 Static_GetPlaneTileID(u8 plane, u16 x, u16 y) {
+    return Static_GetMapEntry(plane, x, y) & 0x7FF;
+}
+
+static inline u8 Static_GetPlaneTilePalette(u8 plane, u16 x, u16 y) {
+    return (Static_GetMapEntry(plane, x, y) >> 13) & 3;
+}
+
+static inline u8 Static_GetPlaneTilePriority(u8 plane, u16 x, u16 y) {
+    return Static_GetMapEntry(plane, x, y) >> 15;
+}
+
+static inline u16 Static_GetPlaneVScroll(u8 plane, u16 col) { // 16 pixel columns, each plane scrolling at its own rate.
+    return (u16)((col >> 4) * (plane + 1) + staticFrame);
+}
+
+static inline u8 Static_GetSpriteColor(u16 sprite, u16 x, u16 y) {
+    const StaticSprite * spr = &staticSprites[sprite];
+    return Static_GetTileColor((u16)(spr->tile + (y >> 3) * (spr->w >> 3) + (x >> 3)), (u8)x, (u8)y);
+}
+
+static inline bool8 Static_ShouldBlankPixel(u32 line, u32 col) { // Blanks the leftmost column like the MD can.
+    return col < 8;
+}
+
+#define VEGA_STATIC_SCREENW STATIC_SCREEN_W
+#define VEGA_STATIC_PLANECOUNT STATIC_PLANES
+#define VEGA_STATIC_TILECOUNT 0
+#define VEGA_STATIC_COLORDEPTH VEGA_INDDPTH_4
+#define VEGA_STATIC_PALETTEDEPTH VEGA_INDDPTH_2
+#define VEGA_STATIC_PRIORITYDEPTH VEGA_INDDPTH_1
+#define VEGA_STATIC_GETTILECOLOR Static_GetTileColor
+#define VEGA_STATIC_GETPLANETILEID Static_GetPlaneTileID
+#define VEGA_STATIC_GETPLANETILEPALETTE Static_GetPlaneTilePalette
+#define VEGA_STATIC_GETPLANETILEPRIORITY Static_GetPlaneTilePriority
+#define VEGA_STATIC_GETPLANEVSCROLL Static_GetPlaneVScroll
+#define VEGA_STATIC_GETSPRITECOLOR Static_GetSpriteColor
+#define VEGA_STATIC_SHOULDBLANKPIXEL Static_ShouldBlankPixel
+
+#endif
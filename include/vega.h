@@ -30,5 +30,7 @@
 #include "vegatypes.h"
 #include "vegaio.h"
 #include "vegavideo.h"
+#include "vegaaudio.h"
+#include "vegacontext.h"
 
 #endif
\ No newline at end of file
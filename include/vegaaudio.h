@@ -0,0 +1,91 @@
+/*
+    Vega Engine audio header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_AUDIO_H
+#define VEGA_AUDIO_H 1
+
+#include "vegatypes.h"
+
+#define VEGA_AUDIO_MAXCHANNELS 32
+
+typedef struct VegaAudioChannel { // Stereo gains of one channel, from -1 to 1.
+    float left;
+    float right;
+} VegaAudioChannel;
+
+typedef struct VegaAudioBackend {
+    u32 sampleRate; // The rate channels are generated at, in Hz.
+    u32 outputRate; // The rate the mix is resampled to, in Hz. If this is 0, 48000 is used. Device mode uses the rate the device accepted instead.
+    u8 channelCount; // Up to VEGA_AUDIO_MAXCHANNELS.
+    u16 blockSize; // Samples generated per channel in one generateCB call. If this is 0, 256 is used.
+    u32 ringFrames; // Stereo frames buffered between the mixer and the output, rounded up to a power of two. If this is 0, 8192 is used.
+    const VegaAudioChannel * channels; // channelCount initial gains. If this is NULL, every channel starts centered at full gain.
+
+    void (*generateCB)(u8 channel, s16 * samples, u32 count); // Writes COUNT mono samples of channel CHANNEL at sampleRate to SAMPLES.
+    void (*initCB)();
+    void (*deinitCB)();
+} VegaAudioBackend;
+
+typedef enum VegaAudioMode {
+    VEGA_AUDMODE_DEVICE, // The mix is played on the default SDL audio device. Falls back to headless if the device cannot be opened.
+    VEGA_AUDMODE_HEADLESS, // The mix stays in the ring for Vega_AudioRead or an audio sink.
+} VegaAudioMode;
+
+typedef enum VegaAudioSinkFormat {
+    VEGA_AUDSINK_WAV, // 16-bit stereo PCM with a RIFF header, sizes filled in on close.
+    VEGA_AUDSINK_RAW, // Headerless 16-bit stereo frames in host byte order.
+} VegaAudioSinkFormat;
+
+typedef struct VegaAudioStats { // Counted since init.
+    u64 framesGenerated; // Samples generated per channel, at sampleRate.
+    u64 framesOut; // Stereo frames put in the ring, at outputRate.
+    u64 droppedFrames; // Stereo frames the ring had no room for.
+    u64 underruns; // Device callbacks that found fewer frames in the ring than they needed and played silence for the rest.
+    u64 mixTime; // Nanoseconds spent generating, mixing and resampling.
+} VegaAudioStats;
+
+// Audio is generated in blocks on the thread that calls Vega_AudioAdvance, usually the video thread from frameEndCB. Channels are mixed
+// to stereo at sampleRate, resampled to outputRate by a band-limited polyphase filter and put in a lock-free ring that one consumer
+// reads from: the device, or in headless mode the audio sink or Vega_AudioRead. When the ring is full the newest frames are dropped.
+cextern void Vega_AudioInit(VegaAudioBackend backend, VegaAudioMode mode);
+cextern void Vega_AudioDeinit();
+cextern void Vega_AudioAdvance(u32 frames); // Generates, mixes and queues FRAMES samples per channel at sampleRate.
+cextern void Vega_AudioSetChannelGain(u8 channel, float left, float right); // Takes effect from the next block. Call from the thread calling Vega_AudioAdvance.
+cextern u32 Vega_AudioRead(s16 * dst, u32 frames); // Moves up to FRAMES interleaved stereo frames from the ring to DST and returns how many it moved. Headless mode only, without a sink.
+cextern u32 Vega_AudioGetQueued(); // Returns the stereo frames waiting in the ring.
+cextern u32 Vega_AudioGetOutputRate();
+// A sink writes the ring to PATH after every Vega_AudioAdvance, so headless runs can be listened to or compared. Opening a sink closes
+// the one already open. Headless mode only. Deinit closes the sink.
+cextern bool8 Vega_AudioOpenSink(const char * path, VegaAudioSinkFormat format);
+cextern void Vega_AudioCloseSink();
+cextern void Vega_AudioGetStats(VegaAudioStats * stats);
+
+#if defined(VEGA_INTERNAL)
+typedef struct VegaAudioState VegaAudioState;
+cextern VegaAudioState * Vega_AudioCreateState();
+cextern void Vega_AudioDestroyState(VegaAudioState * state);
+cextern void Vega_AudioBindState(VegaAudioState * state); // Makes the calling thread use STATE, or the default state if STATE is NULL.
+#endif
+
+#endif
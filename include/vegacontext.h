@@ -0,0 +1,41 @@
+/*
+    Vega Engine context header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_CONTEXT_H
+#define VEGA_CONTEXT_H 1
+
+#include "vegatypes.h"
+
+// A context holds one engine's video, IO and audio state, so several engines can run in one process. The Vega_Video*, Vega_IO*
+// and Vega_Audio* functions act on the context made current on the calling thread, or on the default context if none is. Every
+// thread calling into a context has to make it current first, the render and presentation threads are bound by the engine itself. Only headless
+// contexts may run at the same time, as SDL keeps a single window and event queue per process.
+typedef struct VegaContext VegaContext;
+
+cextern VegaContext * Vega_ContextCreate(); // Returns NULL if allocation fails.
+cextern void Vega_ContextDestroy(VegaContext * ctx); // The context must be deinitialized and current on no other thread.
+cextern void Vega_ContextMakeCurrent(VegaContext * ctx); // Binds CTX to the calling thread, or the default context if CTX is NULL.
+cextern VegaContext * Vega_ContextGetCurrent(); // Returns NULL while the default context is current.
+
+#endif
@@ -60,6 +60,40 @@ typedef struct VegaRegister {
 
 #define VegaRegDef(_size, read, write, cmd) (VegaRegister){.size=_size, .readCB=read, .writeCB=write, .cmdCB=cmd}
 
+typedef struct VegaBusRegion { // A range of addresses backed by memory or by registers. Regions mapped later take precedence.
+    u32 start; // First address of the region.
+    u32 size; // Bytes of address space covered by the region.
+    u8 * mem; // Memory backing the region, or NULL for a register region. Bus writes store into MEM directly, so if it is a video memory area they are not seen by memDirtyCB; report them with Vega_VideoMarkMemLoc.
+    u32 memSize; // Bytes of MEM. The region repeats every MEMSIZE bytes, so a region larger than its memory mirrors it.
+    bool8 readOnly; // Writes to a read-only memory region are dropped.
+    u8 reg; // First register of a register region.
+    u8 regCount; // Registers in a register region. The region repeats every REGCOUNT * REGSTRIDE bytes.
+    u8 regStride; // Bytes of address space per register.
+    u8 access; // VEGA_AFLAG_* sizes the region accepts, or 0 for all of them. Other accesses read 0 and drop writes.
+} VegaBusRegion;
+
+#define VegaBusMemDef(_start, _size, _mem, _memSize, _readOnly) (VegaBusRegion){.start=_start, .size=_size, .mem=_mem, .memSize=_memSize, .readOnly=_readOnly}
+#define VegaBusRegDef(_start, _size, _reg, _regCount, _regStride) (VegaBusRegion){.start=_start, .size=_size, .reg=_reg, .regCount=_regCount, .regStride=_regStride}
+
+typedef struct VegaBusPage { // One entry of the page table.
+    u8 * read; // Memory backing the whole page for reads, offset to the start of the page, or NULL to take the slow path.
+    u8 * write; // Same as READ for writes. NULL for read-only memory.
+    u16 region; // Index of the only region in the page, or one of the VEGA_BUSPAGE_* values.
+} VegaBusPage;
+
+#define VEGA_BUSPAGE_UNMAPPED 0xFFFF
+#define VEGA_BUSPAGE_SHARED 0xFFFE // More than one region touches the page, so the slow path searches them.
+
+typedef struct VegaBusState { // Only exposed so the accessors below can be inlined. Use the functions to change it.
+    VegaBusPage * pages;
+    u32 addrMask;
+    u32 pageMask;
+    u8 pageBits;
+    bool8 bigEndian;
+} VegaBusState;
+
+cextern __thread VegaBusState * Vega_IOBus; // Bus of the context bound to the calling thread.
+
 cextern void Vega_IOInit(const VegaRegister * regs, u8 count);
 cextern void Vega_IODeinit();
 cextern u8 Vega_IOGetRegCount();
@@ -73,4 +107,129 @@ cextern void Vega_IORegLCmd(u8 id, u8 cmdid, u32 * data, u8 len);
 cextern void Vega_IORegWCmd(u8 id, u8 cmdid, u16 * data, u8 len);
 cextern void Vega_IORegBCmd(u8 id, u8 cmdid, u8 * data, u8 len);
 
+// Queues register writes and commands in a ring of CAPACITY entries (rounded up to a power of two) instead of running them on the
+// caller's thread, or runs them synchronously again if CAPACITY is 0. There must be one producer thread and one consumer thread,
+// which may be the same thread, and neither may be using the registers while the mode changes. Register reads and command pointers are not deferred, so PCmd data
+// has to stay valid until the command is drained. A full ring makes the producer wait for the consumer, unless the producer is the
+// thread that drains the queue: then the oldest entry runs early to make room.
+// The video loop drains the queue on the video thread before frameStartCB, before each lineStartCB and when HBlank starts on a
+// visible line. Stamp entries with Vega_IOSetTime in raster pixels, ((frame * scanH) + line) * scanW + col, where FRAME counts from
+// 0 at init and HBlank starts at col screenW. Entries stamped later stay queued until their position is reached.
+cextern void Vega_IOSetAsync(u32 capacity);
+cextern bool8 Vega_IOIsAsync();
+cextern void Vega_IOSetTime(u64 time); // Stamps the writes and commands queued after this call with TIME. Call from the producer thread.
+cextern u32 Vega_IODrain(u64 time); // Runs every queued entry stamped at or before TIME, in order. Returns how many ran. Call from the consumer thread.
+
+// Builds a bus of (1 << ADDRBITS) addresses split into pages of (1 << PAGEBITS) bytes, with PAGEBITS clamped to 2 to 30. Multi-byte
+// memory accesses use the byte order given by BIGENDIAN. Accesses that stay inside a page fully backed by memory are a single page
+// table lookup.
+cextern void Vega_IOBusInit(u8 addrBits, u8 pageBits, bool8 bigEndian);
+cextern void Vega_IOBusDeinit();
+cextern bool8 Vega_IOBusMap(VegaBusRegion region); // Older regions REGION covers completely are dropped. Returns false if REGION is empty, outside the bus or the region list can't grow.
+cextern bool8 Vega_IOBusUnmap(u32 start, u32 size);
+cextern u32 Vega_IOBusSlowRead(u32 addr, VegaAccessSize size);
+cextern void Vega_IOBusSlowWrite(u32 addr, u32 val, VegaAccessSize size);
+cextern void Vega_IOBusReadBlock(u32 addr, void * dst, u32 len); // Copies LEN bytes starting at ADDR, a page at a time where possible. Register bytes are read one at a time.
+cextern void Vega_IOBusWriteBlock(u32 addr, const void * src, u32 len);
+
+#if defined(VEGA_INTERNAL)
+typedef struct VegaIOState VegaIOState;
+cextern VegaIOState * Vega_IOCreateState();
+cextern void Vega_IODestroyState(VegaIOState * state);
+cextern void Vega_IOBindState(VegaIOState * state); // Makes the calling thread use STATE, or the default state if STATE is NULL.
+#endif
+
+static inline u8 Vega_IOBusRead8(u32 addr) {
+    const VegaBusState * bus = Vega_IOBus;
+    const VegaBusPage * page;
+    addr &= bus->addrMask;
+    page = &bus->pages[addr >> bus->pageBits];
+    if (page->read) return page->read[addr & bus->pageMask];
+    return (u8)Vega_IOBusSlowRead(addr, ACCESS_BYTE);
+}
+
+static inline u16 Vega_IOBusRead16(u32 addr) {
+    const VegaBusState * bus = Vega_IOBus;
+    const VegaBusPage * page;
+    const u8 * p;
+    addr &= bus->addrMask;
+    page = &bus->pages[addr >> bus->pageBits];
+    if (page->read && (addr & bus->pageMask) < bus->pageMask) {
+        p = &page->read[addr & bus->pageMask];
+        return bus->bigEndian ? (u16)((p[0] << 8) | p[1]) : (u16)(p[0] | (p[1] << 8));
+    }
+    return (u16)Vega_IOBusSlowRead(addr, ACCESS_WORD);
+}
+
+static inline u32 Vega_IOBusRead32(u32 addr) {
+    const VegaBusState * bus = Vega_IOBus;
+    const VegaBusPage * page;
+    const u8 * p;
+    addr &= bus->addrMask;
+    page = &bus->pages[addr >> bus->pageBits];
+    if (page->read && (addr & bus->pageMask) < bus->pageMask - 2) {
+        p = &page->read[addr & bus->pageMask];
+        if (bus->bigEndian) return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+        return p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+    }
+    return Vega_IOBusSlowRead(addr, ACCESS_LONG);
+}
+
+static inline void Vega_IOBusWrite8(u32 addr, u8 val) {
+    const VegaBusState * bus = Vega_IOBus;
+    const VegaBusPage * page;
+    addr &= bus->addrMask;
+    page = &bus->pages[addr >> bus->pageBits];
+    if (page->write) page->write[addr & bus->pageMask] = val;
+    else Vega_IOBusSlowWrite(addr, val, ACCESS_BYTE);
+}
+
+static inline void Vega_IOBusWrite16(u32 addr, u16 val) {
+    const VegaBusState * bus = Vega_IOBus;
+    const VegaBusPage * page;
+    u8 * p;
+    addr &= bus->addrMask;
+    page = &bus->pages[addr >> bus->pageBits];
+    if (page->write && (addr & bus->pageMask) < bus->pageMask) {
+        p = &page->write[addr & bus->pageMask];
+        p[!bus->bigEndian] = (u8)(val >> 8);
+        p[bus->bigEndian] = (u8)val;
+    } else {
+        Vega_IOBusSlowWrite(addr, val, ACCESS_WORD);
+    }
+}
+
+static inline void Vega_IOBusWrite32(u32 addr, u32 val) {
+    const VegaBusState * bus = Vega_IOBus;
+    const VegaBusPage * page;
+    u8 * p;
+    u8 i;
+    addr &= bus->addrMask;
+    page = &bus->pages[addr >> bus->pageBits];
+    if (page->write && (addr & bus->pageMask) < bus->pageMask - 2) {
+        p = &page->write[addr & bus->pageMask];
+        for (i = 0; i < 4; i++) {
+            p[bus->bigEndian ? 3 - i : i] = (u8)(val >> (i * 8));
+        }
+    } else {
+        Vega_IOBusSlowWrite(addr, val, ACCESS_LONG);
+    }
+}
+
+static inline u32 Vega_IOBusRead(u32 addr, VegaAccessSize size) {
+    switch (size) {
+        case ACCESS_BYTE: return Vega_IOBusRead8(addr);
+        case ACCESS_WORD: return Vega_IOBusRead16(addr);
+        default: return Vega_IOBusRead32(addr);
+    }
+}
+
+static inline void Vega_IOBusWrite(u32 addr, u32 val, VegaAccessSize size) {
+    switch (size) {
+        case ACCESS_BYTE: Vega_IOBusWrite8(addr, (u8)val); break;
+        case ACCESS_WORD: Vega_IOBusWrite16(addr, (u16)val); break;
+        default: Vega_IOBusWrite32(addr, val); break;
+    }
+}
+
 #endif
\ No newline at end of file
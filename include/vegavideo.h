@@ -30,6 +30,8 @@
 
 typedef u16 VegaVideoColor; // Arranged in RRRRR GGGGG BBBBB E (E = enabled/transparent)
 
+#define VEGA_VIDMEM_DIRTYBLOCK 32 // Granularity of the ranges passed to memDirtyCB, in bytes.
+
 typedef enum VegaVideoIndexDepth {
     VEGA_INDDPTH_0, // 0 bits per index, 1 possible index (this is invalid for color indexing)
     VEGA_INDDPTH_1, // 1 bit per index, 2 possible indexes
@@ -42,6 +44,16 @@ typedef enum VegaVideoIndexDepth {
     VEGA_INDDPTH_8, // 8 bits per index, 256 possible indexes
 } VegaVideoIndexDepth;
 
+#define VEGA_VIDSPAN_MAX 8 // Most spans getBlankSpans and getPlaneWindow can return for one line.
+
+typedef struct VegaVideoSpan { // Columns START up to but not including END.
+    u16 start;
+    u16 end;
+} VegaVideoSpan;
+
+typedef u64 VegaVideoEventID; // 0 never names an event.
+typedef void (*VegaVideoEventCB)(u64 time, void * data); // Called with the raster time the event was scheduled for and the DATA it was scheduled with.
+
 typedef struct VegaVideoBackend { // Constant settings and 
     u16 screenW; // The width of the internal screen buffer, in pixels.
     u16 screenH; // The height of the internal screen buffer, in pixels.
@@ -52,15 +64,20 @@ typedef struct VegaVideoBackend { // Constant settings and
     u32 * memLocSizes; // An array of memory area sizes to be allocated. Ex: VRAM, CRAM/CGRAM, etc.
     u8 regCount; // The amount of entries in the regs field.
     u8 * regs; // An array of register IDs the video subsystem needs access to.
+    u32 stateSize; // Bytes of backend state, such as register values, saved along with the memory areas in snapshots.
+    void (*saveStateCB)(u8 * dst); // Writes stateSize bytes of backend state to DST. If this is NULL, no backend state is saved.
+    void (*loadStateCB)(const u8 * src); // Restores the backend state written by saveStateCB. The engine's caches are invalidated afterwards.
 
     VegaVideoIndexDepth colorIndexDepth; // Bits per color index in a palette, typically stored in the tile/sprite data. (Ex: MD/Gen = VEGA_INDDPTH_4)
     VegaVideoIndexDepth paletteIndexDepth; // Bits per palette index, typically stored in layout/sprite data. (Ex: MD/Gen = VEGA_INDDPTH_2)
     VegaVideoIndexDepth priorityIndexDepth; // Bits per priority index, typically stored in layout/sprite data. (Ex: MD/Gen = VEGA_INDDPTH_1)
-    u8 spriteCount; // Maximum number of sprites to render. You can limit the maximum number of sprites by always returning false in getSpriteEnabled after a certain ID.
+    u16 spriteCount; // Maximum number of sprites to render. You can limit the maximum number of sprites by always returning false in getSpriteEnabled after a certain ID.
+    u16 spriteLineLimit; // Maximum number of sprites drawn on a single line. Sprites later in the chain are dropped first. If this is 0, there is no limit.
     u8 planeCount; // Maximum number of planes to render. You can limit the maximum number of planes by always returning false in getPlaneEnabled after a certain ID.
+    u16 tileCount; // Number of tiles kept decoded in the engine's tile cache. The backend must call Vega_VideoUpdateTileCache when a cached tile changes. If this is 0, getTileColor is called for every tile row drawn.
 
-    VegaVideoColor (*getClearColor)(); // Returns the background color.
-    VegaVideoColor (*getPaletteColor)(u8 palette, u8 color); // Returns the appropriate color from the color lookup memory.
+    VegaVideoColor (*getClearColor)(); // Returns the background color. Cached by the engine, call Vega_VideoUpdateClearColor when it changes.
+    VegaVideoColor (*getPaletteColor)(u8 palette, u8 color); // Returns the appropriate color from the color lookup memory. Cached by the engine, call Vega_VideoUpdatePaletteCache when a palette line changes.
     bool8 (*getDisplayEnabled)(); // Returns false to disable rendering. If this is NULL, rendering will always occur.
 
     u8 (*getTileColor)(u16 tile, u8 x, u8 y); // Returns the color index at pixel coordinate (X, Y) in tile TILE.
@@ -73,21 +90,30 @@ typedef struct VegaVideoBackend { // Constant settings and
     u16 (*getPlaneHMod)(u8 plane); // Returns the width in pixels of plane PLANE.
     u16 (*getPlaneVMod)(u8 plane); // Returns the height in pixels of plane PLANE.
     bool8 (*getPlaneEnabled)(u8 plane); // Returns true if plane PLANE should be rendered, false otherwise. If this is NULL, all planes will always be rendered.
+    void (*getPlaneLine)(u8 plane, u16 line, u8 * colors, u8 * palettes, u8 * priorities); // Fills screenW entries of COLORS, PALETTES and PRIORITIES with the scrolled contents of line LINE of plane PLANE. If this is NULL, the per-pixel plane callbacks above are used.
+    void (*getPlaneHScrollTable)(u8 plane, u16 * rows); // Fills screenH entries of ROWS with the horizontal scroll of each row of plane PLANE. Fetched once per frame and again after Vega_VideoUpdatePlaneCache. If this is NULL, getPlaneHScroll is called once per line.
+    void (*getPlaneVScrollTable)(u8 plane, u16 * cols); // Fills screenW entries of COLS with the vertical scroll of each column of plane PLANE. Fetched once per frame and again after Vega_VideoUpdatePlaneCache. If this is NULL, getPlaneVScroll is called once per pixel.
 
-    u8 (*getSpriteColor)(u8 sprite, u16 x, u16 y); // Returns the color index at pixel coordinate (X, Y) in sprite SPRITE.
-    u8 (*getSpritePriority)(u8 sprite); // Returns the priority of sprite SPRITE.
-    u8 (*getSpritePalette)(u8 sprite); // Returns the palette of sprite SPRITE.
-    u16 (*getSpriteX)(u8 sprite); // Returns the x position in pixels of sprite SPRITE.
-    u16 (*getSpriteY)(u8 sprite); // Returns the y position in pixels of sprite SPRITE.
-    u16 (*getSpriteW)(u8 sprite); // Returns the width in pixels of sprite SPRITE.
-    u16 (*getSpriteH)(u8 sprite); // Returns the height in pixels of sprite SPRITE.
-    bool8 (*getSpriteEnabled)(u8 sprite); // Returns true if sprite SPRITE should be rendered, false otherwise. If this is NULL, all sprites will always be rendered.
-    u8 (*getSpriteFirst)(); // Returns the first sprite to render. If NULL, rendering will always start with the last sprite.
-    u8 (*getSpriteLink)(u8 sprite); // Returns the sprite to render after sprite SPRITE. If NULL, the next sprite will be the one with the next lowest ID.
-    bool8 (*getSpriteEnd)(u8 sprite); // Returns true if SPRITE is the last sprite to render. If NULL, the last sprite is sprite 0.
+    u8 (*getSpriteColor)(u16 sprite, u16 x, u16 y); // Returns the color index at pixel coordinate (X, Y) in sprite SPRITE.
+    u8 (*getSpritePriority)(u16 sprite); // Returns the priority of sprite SPRITE.
+    u8 (*getSpritePalette)(u16 sprite); // Returns the palette of sprite SPRITE.
+    u16 (*getSpriteX)(u16 sprite); // Returns the x position in pixels of sprite SPRITE.
+    u16 (*getSpriteY)(u16 sprite); // Returns the y position in pixels of sprite SPRITE.
+    u16 (*getSpriteW)(u16 sprite); // Returns the width in pixels of sprite SPRITE.
+    u16 (*getSpriteH)(u16 sprite); // Returns the height in pixels of sprite SPRITE.
+    bool8 (*getSpriteEnabled)(u16 sprite); // Returns true if sprite SPRITE should be rendered, false otherwise. If this is NULL, all sprites will always be rendered.
+    u16 (*getSpriteFirst)(); // Returns the first sprite to render. If NULL, rendering will always start with sprite spriteCount-1.
+    u16 (*getSpriteLink)(u16 sprite); // Returns the sprite to render after sprite SPRITE. If NULL, the next sprite will be the one with the next lowest ID.
+    bool8 (*getSpriteEnd)(u16 sprite); // Returns true if SPRITE is the last sprite to render; SPRITE itself is still rendered. If NULL, the last sprite is sprite 0, which is rendered.
 
     bool8 (*shouldBlankLine)(u32 line); // Returns true if line LINE should be filled with background color, false otherwise. If this is NULL, no lines will be blanked.
-    bool8 (*shouldBlankPixel)(u32 line, u32 col); // Returns true if the pixel at (COL, LINE) should be filled with background color, false otherwise. If this is NULL, no blanking will occur.
+    bool8 (*shouldBlankPixel)(u32 line, u32 col); // Returns true if the pixel at (COL, LINE) should be filled with background color, false otherwise. Only called for columns getBlankSpans left visible. If this is NULL, no blanking will occur.
+    // Writes up to VEGA_VIDSPAN_MAX spans of line LINE to be filled with background color to SPANS, in order and not overlapping, and returns how many it wrote.
+    // Captured with the line's raster state, and nothing is drawn in the spans. If this is NULL, no spans are blanked.
+    u8 (*getBlankSpans)(u32 line, VegaVideoSpan * spans);
+    // Writes up to VEGA_VIDSPAN_MAX spans of line LINE where plane PLANE is shown to SPANS, in order and not overlapping, and returns how many it wrote.
+    // The plane is not drawn outside of them, so the planes and sprites below show through. Captured with the line's raster state. If this is NULL, planes cover the whole line.
+    u8 (*getPlaneWindow)(u8 plane, u32 line, VegaVideoSpan * spans);
 
     void (*initCB)(); // Called once to initialize the video subsytem.
     void (*deinitCB)(); // Called once to deinitialize the video subsytem.
@@ -97,21 +123,181 @@ typedef struct VegaVideoBackend { // Constant settings and
     void (*lineStartCB)(u16 line); // Called once before a line is drawn.
     void (*lineEndCB)(u16 line); // Called once after a line is drawn.
     void (*hBlankCB)(u16 line); // Called once HBlank starts.
+    // Runs the emulated machine until raster time TIME. Called before every scheduled event, before the raster callbacks set above,
+    // before every visible line is captured and at the end of the frame, so the machine runs in slices from one of those to the next.
+    // If this is NULL, only the events and callbacks mark time.
+    void (*runUntilCB)(u64 time);
+    void (*memDirtyCB)(u8 memLoc, u32 offset, u32 len); // Called before a line is captured for each range of memory area MEMLOC changed through the DMA functions since the last call, rounded out to VEGA_VIDMEM_DIRTYBLOCK bytes. Call the Vega_VideoUpdate functions for what the range holds. If this is NULL, no ranges are tracked.
 } VegaVideoBackend;
 
+typedef enum VegaVideoArenaType {
+    VEGA_ARENA_HEAP, // A page-aligned heap block. This is the default.
+    VEGA_ARENA_HUGEPAGES, // Anonymous memory aligned to 2 MiB and marked for transparent huge pages.
+    VEGA_ARENA_FILE, // A shared mapping of the file at the given path, created or resized as needed. The memory areas keep what the file held.
+    VEGA_ARENA_SHM, // A shared mapping of the POSIX shared memory object with the given name (Ex: "/vega"). It is not unlinked on deinit.
+} VegaVideoArenaType;
+
+typedef enum VegaVideoMode {
+    VEGA_VIDMODE_WINDOW, // Frames are drawn into a window using the compiled-in rendering API.
+    VEGA_VIDMODE_HEADLESS, // Frames are drawn into an engine-owned framebuffer. No window is created, no events are polled, nothing is presented and frames run uncapped unless a refresh rate is set.
+} VegaVideoMode;
+
+#define VEGA_VIDSTATS_LINEBUCKETS 16
+
+typedef enum VegaVideoCallbackType {
+    VEGA_VIDCB_PALETTE, // getClearColor and getPaletteColor.
+    VEGA_VIDCB_TILE, // getTileColor.
+    VEGA_VIDCB_PLANETILE, // getPlaneTileID, getPlaneTilePalette and getPlaneTilePriority.
+    VEGA_VIDCB_PLANESCROLL, // getPlaneEnabled, the scroll and size callbacks and the scroll tables.
+    VEGA_VIDCB_PLANELINE, // getPlaneLine.
+    VEGA_VIDCB_SPRITECOLOR, // getSpriteColor.
+    VEGA_VIDCB_SPRITEATTRIB, // The sprite attribute and chain callbacks.
+    VEGA_VIDCB_BLANK, // shouldBlankLine, shouldBlankPixel, getBlankSpans and getPlaneWindow.
+    VEGA_VIDCB_EVENT, // The frame, line and blanking callbacks, scheduled events and runUntilCB.
+    VEGA_VIDCB_COUNT,
+} VegaVideoCallbackType;
+
+typedef struct VegaVideoStats { // Times are in nanoseconds and cover the last finished frame unless noted otherwise.
+    u64 frames; // Frames finished since init.
+    u64 lateFrames; // Frames since init that were done after their deadline.
+    u64 frameTime; // From the start of the frame to the start of the next one.
+    u64 frameTimeMax; // Longest frameTime since init.
+    u64 renderTime; // Drawing the frame, including the backend callbacks made while drawing it.
+    u64 presentTime; // Handing the frame to the window or the presentation thread, the frame callback and the frame sink.
+    u64 sleepTime; // Waiting for the frame deadline.
+    u64 lineTimeMax; // Slowest visible line.
+    u64 skippedFrames; // Frames since init that a newer frame replaced before the presentation thread showed them.
+    u64 droppedFrames; // Frames since init that the frame sink had no free slot for.
+    u32 linesDrawn; // Visible lines drawn during the frame. Lines reused by incremental rendering are left out.
+    u32 lineTimes[VEGA_VIDSTATS_LINEBUCKETS]; // Visible lines by draw time. Bucket N counts lines under 2^(N+9) ns that did not fit a lower bucket, the last bucket also counts every slower line.
+    u32 callbacks[VEGA_VIDCB_COUNT]; // Backend callback calls made during the frame, by type.
+} VegaVideoStats;
+
+typedef enum VegaVideoFormat { // Output formats. The 32-bit ones are opaque and widen each channel by repeating its top bits.
+    VEGA_VIDFMT_RGBA8888, // Bytes in R, G, B, A order.
+    VEGA_VIDFMT_BGRA8888, // Bytes in B, G, R, A order.
+    VEGA_VIDFMT_RGB565, // 16 bits arranged RRRRR GGGGGG BBBBB.
+} VegaVideoFormat;
+
+#define VEGA_VIDOUT_MAXSCALE 4
+
+typedef struct VegaVideoOutput {
+    VegaVideoFormat format;
+    u8 scale; // Each pixel becomes a SCALE by SCALE block, 1 to VEGA_VIDOUT_MAXSCALE. 0 counts as 1.
+    bool8 scanlines; // Halves the brightness of the last row of every block. Ignored at scale 1.
+} VegaVideoOutput;
+
+#define VEGA_VIDSINK_MAGIC 0x4B4E5356 // "VSNK"
+#define VEGA_VIDSINK_SLOTHEADER 64 // Bytes before the pixels in each slot. The slot starts with the u64 number of the frame it holds, counted from 0 at init.
+
+// Layout of a shared memory frame sink. Slot N sits at dataOffset + (N * slotSize) and holds H rows of pitch bytes in FORMAT.
+// The engine fills slots in sequence and bumps writeSeq once sequence number writeSeq is in slot (writeSeq % slotCount). The consumer owns
+// every published slot from readSeq on until it bumps readSeq past it, so frames are read in place. A consumer joining late can set
+// readSeq to writeSeq to skip the frames waiting in the ring.
+typedef struct VegaVideoSinkHeader {
+    u32 magic; // Written last, once the rest of the header is valid.
+    u32 slotCount;
+    u32 slotSize;
+    u32 pitch;
+    u16 w; // Frame size after scaling.
+    u16 h;
+    u32 format; // A VegaVideoFormat.
+    u64 dataOffset;
+    u64 writeSeq __attribute__((aligned(64))); // Only written by the engine, with release ordering.
+    u64 readSeq __attribute__((aligned(64))); // Only written by the consumer, with release ordering.
+} VegaVideoSinkHeader;
+
+typedef void (*VegaVideoFrameCB)(const VegaVideoColor * pixels, u16 w, u16 h, u32 pitch); // Called with each finished frame. PITCH is the length of a row in bytes.
+
 cextern void Vega_VideoInit(VegaVideoBackend backend);
+cextern void Vega_VideoInitMode(VegaVideoBackend backend, VegaVideoMode mode); // Exits if BACKEND differs from the one a static build was specialized for, see src/vegabackend.h.
 cextern void Vega_VideoRun();
+cextern void Vega_VideoRunFrames(u32 frames); // Runs FRAMES frames, or until Vega_VideoStop is called if FRAMES is 0.
+cextern void Vega_VideoStop();
 cextern void Vega_VideoDeinit();
 
+// The memory areas, the headless framebuffer, the line buffers, caches and journals are carved out of one arena allocated at init and freed
+// at deinit. The engine-owned memory areas each start on a page boundary, in order; other tools can find them with Vega_VideoGetMemLocOffset.
+cextern void Vega_VideoSetArena(VegaVideoArenaType type, const char * path); // Call before init. If the mapping fails, the arena falls back to the heap.
+cextern void * Vega_VideoGetArena(u64 * size); // Returns the arena and writes its size to SIZE if SIZE is not NULL.
+cextern u64 Vega_VideoGetMemLocOffset(u8 index); // Returns where memory area INDEX starts in the arena, or UINT64_MAX if it is mapped to a caller-owned buffer.
 cextern void Vega_VideoSetTitle(const char * name);
+cextern void Vega_VideoSetRefreshRate(double hz); // Frames are paced to HZ per second (60 by default in window mode), or run as fast as possible if HZ is 0. Call after init.
+// Draws bands of BANDLINES lines (16 if 0) on THREADS worker threads, or on the calling thread if THREADS is 0. Call between init and run.
+// Raster callbacks still run on the calling thread and their effect on scroll, palettes and enable flags is recorded per line.
+// The pixel callbacks (tile, plane tile, column scroll, plane line, sprite color and shouldBlankPixel) run on the workers, so call
+// Vega_VideoUpdatePlaneCache, Vega_VideoUpdateTileCache or Vega_VideoUpdateSpriteCache before the data they read changes mid-frame.
+// Those wait for the workers to finish the lines already captured.
+cextern bool8 Vega_VideoSetRenderThreads(u8 threads, u16 bandLines); // Returns false, drawing on the calling thread, if the threads can't all be started.
+// With ENABLED, window mode draws frames into a ring of three engine-owned buffers, and a presentation thread uploads and presents the
+// newest finished one, so a stall in the driver or in vsync never holds up the video loop. Frames finished faster than they are shown are
+// skipped and counted in VegaVideoStats.skippedFrames. The SDL renderer then lives on that thread instead of the one that created the
+// window, which not every platform supports (macOS and some Windows drivers don't), so it is off by default. Call before init.
+cextern void Vega_VideoSetPresentThread(bool8 enabled);
+cextern void Vega_VideoSetFrameCB(VegaVideoFrameCB cb);
+// A frame sink hands every finished frame to a consumer outside the engine, converted by the output stage, right after the frame callback. The video loop
+// never waits on it: a frame that finds every slot taken is dropped and counted in VegaVideoStats.droppedFrames. Opening a sink closes
+// the one already open. Call between frames, after init. Deinit closes the sink.
+cextern bool8 Vega_VideoOpenSinkFD(int fd, u32 slots); // Writes frames back to back to FD, eg. a pipe to an encoder, from a thread of its own that can fall SLOTS frames behind. FD is left open. Closing waits for the frames still queued, so a consumer that stops reading has to close its end.
+cextern bool8 Vega_VideoOpenSinkShm(const char * name, u32 slots); // Creates the POSIX shared memory object NAME with a VegaVideoSinkHeader and SLOTS slots. It is unlinked on close.
+cextern void Vega_VideoCloseSink();
+cextern void Vega_VideoSetSinkOutput(VegaVideoOutput output); // Sets the format of sinks opened afterwards. RGBA8888 at scale 1 by default.
+// The output stage converts frames for consumers outside the engine, using the widest SIMD kernels the CPU has. It works on any frame,
+// eg. in the frame callback or on Vega_VideoGetFrame, and can be called before init.
+cextern u32 Vega_VideoGetOutputPitch(VegaVideoOutput output, u16 w); // Bytes in one row of a converted frame W pixels wide, rows packed without padding.
+cextern void Vega_VideoConvertFrame(VegaVideoOutput output, void * dst, u32 dstPitch, const VegaVideoColor * src, u32 srcPitch, u16 w, u16 h); // Writes H * scale rows to DST.
+// Only draws the visible lines whose captured state changed since they were last drawn, and keeps the last frame's pixels for the rest. Call between frames.
+// Lines are compared by palette colors, clear color, blanking, plane enable, window, scroll and size, the scroll tables, the sprites on the line and the cached tiles
+// they drew. Without getPlaneVScrollTable, getPlaneVScroll is called for every column of every line to compare the column scroll. Changes to anything else the pixel callbacks read, such as plane layouts, uncached tiles, sprite pixels, getPlaneLine data or shouldBlankPixel,
+// have to be reported with Vega_VideoUpdatePlaneCache, Vega_VideoUpdateTileCache, Vega_VideoUpdateSpriteCache or Vega_VideoInvalidateLines.
+cextern void Vega_VideoSetIncremental(bool8 enabled);
+// Snapshots hold every engine-owned memory area, the raster position and the backend state. Areas mapped to caller-owned buffers
+// are left out. Save and load between frames, after draining any queued register writes.
+cextern u32 Vega_VideoGetStateSize();
+cextern void Vega_VideoSaveState(void * dst); // Writes Vega_VideoGetStateSize() bytes to DST.
+cextern bool8 Vega_VideoLoadState(const void * src, u32 size); // Returns false and changes nothing if SRC was saved with a different layout.
+cextern void Vega_VideoSetRewind(u32 frames, u32 bytes); // Keeps up to FRAMES frames of history as XOR deltas in a ring of BYTES bytes, captured after every frame. 0 turns it off.
+cextern u32 Vega_VideoRewind(u32 frames); // Restores the state from FRAMES frames ago, or the oldest kept one. Returns how many frames it went back.
+cextern u32 Vega_VideoGetRewindFrames(); // Returns how many frames Vega_VideoRewind can currently go back.
+// Raster time counts pixels since init, ((frame * scanH) + line) * scanW + col. Events scheduled for a raster time run in time order,
+// those due at the same time in the order they were scheduled, and before any raster callback at that time. They can be scheduled
+// and cancelled from any callback on the video thread, including other events. Events are not part of snapshots.
+cextern VegaVideoEventID Vega_VideoScheduleEvent(u64 time, VegaVideoEventCB cb, void * data); // Events due in the past run at the next point the video loop stops at. Returns 0 on failure.
+cextern bool8 Vega_VideoCancelEvent(VegaVideoEventID id); // Returns false if the event already ran or was cancelled.
+cextern u64 Vega_VideoGetNextEventTime(); // Returns the time of the earliest pending event, or UINT64_MAX if there is none.
+cextern u64 Vega_VideoGetRasterTime(u32 * line, u32 * col); // Returns the raster time the video loop has reached and writes its line and column to LINE and COL if they are not NULL. Inside runUntilCB, this is the end of the slice.
+// Tracing records when frames, lines, render bands, the raster and cache callbacks, presenting and sleeping begin and end, into a ring
+// per thread keeping its newest EVENTS events. It covers every context in the process, and the audio mixer. Turning it on or off and
+// dumping are only safe while no video loop runs. Builds with VEGA_TRACE set to 0 leave it out.
+cextern void Vega_VideoSetTrace(u32 events); // Throws away what was recorded and records up to EVENTS events per thread from now on, or stops if EVENTS is 0.
+cextern bool8 Vega_VideoDumpTrace(const char * path); // Writes the recorded events to PATH in the Chrome trace event format, for Perfetto or chrome://tracing.
+cextern void Vega_VideoGetStats(VegaVideoStats * stats); // Copies the statistics kept for the last finished frame. Call from the thread running the video loop.
+cextern const VegaVideoColor * Vega_VideoGetFrame(); // Returns the last finished frame in headless mode, or NULL otherwise. Rows are screenW pixels long.
+
+#if defined(VEGA_INTERNAL)
+typedef struct VegaVideoState VegaVideoState;
+struct VegaContext;
+cextern VegaVideoState * Vega_VideoCreateState(struct VegaContext * owner); // OWNER is made current on the threads the engine starts for this state.
+cextern void Vega_VideoDestroyState(VegaVideoState * state);
+cextern void Vega_VideoBindState(VegaVideoState * state); // Makes the calling thread use STATE, or the default state if STATE is NULL.
+#endif
 
 #if defined(VEGA_VIDEO_BACKEND) || defined(VEGA_INTERNAL)
 cextern void * Vega_VideoGetMemLoc(u8 index);
+cextern u32 Vega_VideoGetMemLocSize(u8 index);
+cextern void Vega_VideoMapMemLoc(u8 index, void * buffer, u32 size); // Makes memory area INDEX use BUFFER, which stays owned by the caller, without copying it. If BUFFER is NULL, the area gets a cleared engine-owned buffer again.
+cextern void Vega_VideoDMACopy(u8 index, u32 offset, const void * src, u32 len); // Copies LEN bytes of SRC to OFFSET in memory area INDEX.
+cextern void Vega_VideoDMAFill(u8 index, u32 offset, u8 value, u32 len); // Sets LEN bytes at OFFSET in memory area INDEX to VALUE.
+cextern void Vega_VideoDMAFill16(u8 index, u32 offset, u16 value, u32 count); // Sets COUNT host-order words at OFFSET in memory area INDEX to VALUE.
+cextern void Vega_VideoMarkMemLoc(u8 index, u32 offset, u32 len); // Reports a change made to memory area INDEX without the DMA functions.
 cextern bool8 Vega_VideoInHBlank();
 cextern bool8 Vega_VideoInVBlank();
-cextern void Vega_VideoUpdatePaletteCache();
+cextern void Vega_VideoUpdatePaletteCache(u8 line);
+cextern void Vega_VideoUpdateClearColor();
+cextern void Vega_VideoUpdateTileCache(u16 tile);
 cextern void Vega_VideoUpdatePlaneCache(u8 plane);
-cextern void Vega_VideoUpdateSpriteCache(u8 sprite);
+cextern void Vega_VideoUpdateSpriteCache(u16 sprite);
+cextern void Vega_VideoInvalidateLines(u32 first, u32 count); // Makes incremental rendering draw COUNT lines from line FIRST again.
 #endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,423 @@
+/*
+    Vega Engine audio sources.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define VEGA_INTERNAL 1
+#include "../include/vega.h"
+#include "vegasimd.h"
+#include "vegatrace.h"
+
+#if RENDER_SDL
+#include <SDL2/SDL.h>
+#endif
+
+#define VEGA_AUDIO_PHASEBITS 8 // The resampler keeps a filter for each of 2^PHASEBITS positions between two input samples.
+#define VEGA_AUDIO_COEFBITS 14
+#define VEGA_AUDIO_BASETAPS 16 // Taps when not decimating. Decimating widens the filter with the rate ratio, up to VEGA_AUDIO_MAXTAPS.
+#define VEGA_AUDIO_MAXTAPS 64
+#define VEGA_AUDIO_WAVHEADER 44
+
+struct VegaAudioState { // Everything one context's audio subsystem keeps between calls.
+    VegaAudioBackend audioBackend;
+    VegaAudioMode audioMode;
+    s16 gains[VEGA_AUDIO_MAXCHANNELS][2]; // Left and right, Q15.
+    s16 * channelBuf; // One block of the channel being generated.
+    s32 * mixAcc[2]; // One block of the mix, left and right.
+    s16 * history[2]; // Mixed samples waiting for the resampler, left and right.
+    u32 historyFill;
+    s16 * coefs; // Q14 filters, taps coefficients for each phase. NULL when the rates match and the mix is passed through.
+    u16 taps;
+    u64 step; // Input samples per output frame, 32.32 fixed point.
+    u64 pos; // Position of the next output frame in history, 32.32 fixed point.
+    s16 * outBuf; // Interleaved output frames of one block.
+    s16 * ring; // Interleaved stereo frames.
+    u32 ringMask;
+    u32 ringTail __attribute__((aligned(64))); // Written by the producer only.
+    u32 ringHead __attribute__((aligned(64))); // Written by the consumer only.
+    u64 underruns; // Written by the consumer only.
+    VegaAudioStats audioStats __attribute__((aligned(64)));
+    u32 device; // SDL audio device, 0 if none is open.
+    FILE * sink;
+    VegaAudioSinkFormat sinkFormat;
+    u64 sinkBytes;
+};
+
+static VegaAudioState audioDefault;
+static __thread VegaAudioState * audio __attribute__((tls_model("initial-exec"))) = &audioDefault; // The state of the context bound to the calling thread.
+
+VegaAudioState * Vega_AudioCreateState() {
+    VegaAudioState * state;
+    if (posix_memalign((void **)&state, 64, sizeof(VegaAudioState))) {
+        perror("audio state allocation");
+        return NULL;
+    }
+    memset(state, 0, sizeof(VegaAudioState));
+    return state;
+}
+
+void Vega_AudioDestroyState(VegaAudioState * state) { // The state must be deinitialized and bound to no other thread.
+    if (!state || state == &audioDefault) return;
+    if (audio == state) Vega_AudioBindState(NULL);
+    free(state);
+}
+
+void Vega_AudioBindState(VegaAudioState * state) {
+    audio = state ? state : &audioDefault;
+}
+
+static u64 Vega_AudioNow() {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((u64)spec.tv_sec * 1000000000) + (u64)spec.tv_nsec;
+}
+
+static inline s16 Vega_AudioGain(float gain) {
+    if (gain > 1.0f) gain = 1.0f;
+    if (gain < -1.0f) gain = -1.0f;
+    return (s16)lrintf(gain * INT16_MAX);
+}
+
+static void Vega_AudioPush(const s16 * frames, u32 count) {
+    u32 tail = audio->ringTail;
+    u32 room = audio->ringMask + 1 - (tail - __atomic_load_n(&audio->ringHead, __ATOMIC_ACQUIRE));
+    u32 start = tail & audio->ringMask, first;
+    if (count > room) {
+        audio->audioStats.droppedFrames += count - room;
+        count = room;
+    }
+    first = audio->ringMask + 1 - start;
+    if (first > count) first = count;
+    memcpy(&audio->ring[start * 2], frames, first * 4);
+    memcpy(audio->ring, &frames[first * 2], (count - first) * 4);
+    __atomic_store_n(&audio->ringTail, tail + count, __ATOMIC_RELEASE);
+    audio->audioStats.framesOut += count;
+}
+
+static u32 Vega_AudioPop(VegaAudioState * state, s16 * dst, u32 count) { // Takes the state, as the device callback runs on a thread of SDL's.
+    u32 head = state->ringHead;
+    u32 queued = __atomic_load_n(&state->ringTail, __ATOMIC_ACQUIRE) - head;
+    u32 start = head & state->ringMask, first;
+    if (count > queued) count = queued;
+    first = state->ringMask + 1 - start;
+    if (first > count) first = count;
+    memcpy(dst, &state->ring[start * 2], first * 4);
+    memcpy(&dst[first * 2], state->ring, (count - first) * 4);
+    __atomic_store_n(&state->ringHead, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+#if RENDER_SDL
+static void Vega_AudioDeviceCB(void * data, u8 * stream, int len) {
+    VegaAudioState * state = data;
+    u32 want = (u32)len / 4, got = Vega_AudioPop(state, (s16 *)stream, want);
+    if (got < want) {
+        memset(&stream[got * 4], 0, (want - got) * 4);
+        __atomic_store_n(&state->underruns, state->underruns + 1, __ATOMIC_RELAXED);
+    }
+}
+#endif
+
+static bool8 Vega_AudioOpenDevice() {
+#if RENDER_SDL
+    SDL_AudioSpec want = {0}, have;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        fprintf(stderr, "SDL audio failed to initialize: %s\n", SDL_GetError());
+        return false;
+    }
+    want.freq = (int)audio->audioBackend.outputRate;
+    want.format = AUDIO_S16SYS;
+    want.channels = 2;
+    want.samples = 512;
+    want.callback = Vega_AudioDeviceCB;
+    want.userdata = audio;
+    audio->device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE); // Opened paused.
+    if (!audio->device) {
+        fprintf(stderr, "SDL audio device failed to open: %s\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    audio->audioBackend.outputRate = (u32)have.freq;
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void Vega_AudioCloseDevice() {
+#if RENDER_SDL
+    if (!audio->device) return;
+    SDL_CloseAudioDevice(audio->device);
+    SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    audio->device = 0;
+#endif
+}
+
+static void Vega_AudioBuildFilter() { // Blackman windowed sinc, cut off a little below the lower of the two Nyquist rates.
+    const VegaAudioBackend * backend = &audio->audioBackend;
+    double ratio = (double)backend->sampleRate / backend->outputRate;
+    double cutoff = 0.45 * ((ratio > 1.0) ? 1.0 / ratio : 1.0); // In cycles per input sample.
+    double weights[VEGA_AUDIO_MAXTAPS], sum, d, u;
+    u32 phases = 1u << VEGA_AUDIO_PHASEBITS, half, taps = VEGA_AUDIO_BASETAPS;
+    if (ratio > 1.0) taps = (u32)ceil(VEGA_AUDIO_BASETAPS * ratio / 16) * 16; // Kept a multiple of 16 for the dot product kernels.
+    if (taps > VEGA_AUDIO_MAXTAPS) taps = VEGA_AUDIO_MAXTAPS;
+    half = taps / 2;
+    audio->taps = (u16)taps;
+    for (u32 p = 0; p < phases; p++) {
+        sum = 0;
+        for (u32 k = 0; k < taps; k++) {
+            d = (double)k - (half - 1) - ((double)p / phases); // Distance from the output position to the input sample this tap reads.
+            u = (d + half) / taps;
+            weights[k] = ((d == 0) ? 1.0 : sin(2 * M_PI * cutoff * d) / (2 * M_PI * cutoff * d)) * (0.42 - (0.5 * cos(2 * M_PI * u)) + (0.08 * cos(4 * M_PI * u)));
+            sum += weights[k];
+        }
+        for (u32 k = 0; k < taps; k++) audio->coefs[(p * taps) + k] = (s16)lrint(weights[k] * (1 << VEGA_AUDIO_COEFBITS) / sum); // Each phase passes DC at unity.
+    }
+}
+
+static u32 Vega_AudioResample() {
+    u32 half = audio->taps / 2, count = 0, first, index, fill = audio->historyFill;
+    const s16 * coef;
+    s32 v;
+    if (!audio->coefs) {
+        for (u32 i = 0; i < fill; i++) {
+            audio->outBuf[i * 2] = audio->history[0][i];
+            audio->outBuf[(i * 2) + 1] = audio->history[1][i];
+        }
+        audio->historyFill = 0;
+        return fill;
+    }
+    while ((audio->pos >> 32) + half < fill) {
+        index = (u32)(audio->pos >> 32);
+        coef = &audio->coefs[((u32)audio->pos >> (32 - VEGA_AUDIO_PHASEBITS)) * audio->taps];
+        first = index + 1 - half;
+        for (u8 c = 0; c < 2; c++) {
+            v = (Vega_Simd.firDot(&audio->history[c][first], coef, audio->taps) + (1 << (VEGA_AUDIO_COEFBITS - 1))) >> VEGA_AUDIO_COEFBITS;
+            audio->outBuf[(count * 2) + c] = (s16)((v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v);
+        }
+        audio->pos += audio->step;
+        count++;
+    }
+    first = (u32)(audio->pos >> 32) + 1 - half; // Samples before this are behind every later output frame's filter.
+    if (first > fill) first = fill;
+    for (u8 c = 0; c < 2; c++) memmove(audio->history[c], &audio->history[c][first], (fill - first) * sizeof(s16));
+    audio->historyFill = fill - first;
+    audio->pos -= (u64)first << 32;
+    return count;
+}
+
+static void Vega_AudioFreeBuffers() {
+    free(audio->channelBuf);
+    free(audio->mixAcc[0]);
+    free(audio->mixAcc[1]);
+    free(audio->history[0]);
+    free(audio->history[1]);
+    free(audio->coefs);
+    free(audio->outBuf);
+    free(audio->ring);
+    audio->channelBuf = NULL;
+    audio->mixAcc[0] = audio->mixAcc[1] = NULL;
+    audio->history[0] = audio->history[1] = NULL;
+    audio->coefs = NULL;
+    audio->outBuf = NULL;
+    audio->ring = NULL;
+}
+
+static bool8 Vega_AudioAllocBuffers() {
+    const VegaAudioBackend * backend = &audio->audioBackend;
+    u32 historySize = VEGA_AUDIO_MAXTAPS + backend->blockSize;
+    audio->step = ((u64)backend->sampleRate << 32) / backend->outputRate;
+    audio->taps = 0;
+    if (backend->sampleRate != backend->outputRate) {
+        audio->coefs = malloc(sizeof(s16) * VEGA_AUDIO_MAXTAPS << VEGA_AUDIO_PHASEBITS);
+        if (audio->coefs) Vega_AudioBuildFilter();
+    }
+    audio->historyFill = (audio->taps) ? (audio->taps / 2) - 1 : 0; // Leading silence, so the first output frame lines up with the first input sample.
+    audio->pos = (u64)audio->historyFill << 32;
+    audio->channelBuf = malloc(sizeof(s16) * backend->blockSize);
+    audio->mixAcc[0] = malloc(sizeof(s32) * backend->blockSize);
+    audio->mixAcc[1] = malloc(sizeof(s32) * backend->blockSize);
+    audio->history[0] = calloc(historySize, sizeof(s16));
+    audio->history[1] = calloc(historySize, sizeof(s16));
+    audio->outBuf = malloc(sizeof(s16) * 2 * ((((u64)historySize << 32) / audio->step) + 2));
+    audio->ring = malloc(sizeof(s16) * 2 * (audio->ringMask + 1));
+    if ((backend->sampleRate != backend->outputRate && !audio->coefs) || !audio->channelBuf || !audio->mixAcc[0] || !audio->mixAcc[1] || !audio->history[0] || !audio->history[1] || !audio->outBuf || !audio->ring) {
+        perror("audio buffer allocation");
+        Vega_AudioFreeBuffers();
+        return false;
+    }
+    return true;
+}
+
+void Vega_AudioInit(VegaAudioBackend backend, VegaAudioMode mode) {
+    u32 ringFrames = 1;
+    Vega_SimdInit();
+    if (!backend.outputRate) backend.outputRate = 48000;
+    if (!backend.sampleRate) backend.sampleRate = backend.outputRate;
+    if (!backend.blockSize) backend.blockSize = 256;
+    if (!backend.ringFrames) backend.ringFrames = 8192;
+    if (backend.channelCount > VEGA_AUDIO_MAXCHANNELS) backend.channelCount = VEGA_AUDIO_MAXCHANNELS;
+    while (ringFrames < backend.ringFrames) ringFrames <<= 1;
+    audio->audioBackend = backend;
+    audio->ringMask = ringFrames - 1;
+    audio->ringHead = audio->ringTail = 0;
+    audio->underruns = 0;
+    memset(&audio->audioStats, 0, sizeof(VegaAudioStats));
+    for (u8 c = 0; c < backend.channelCount; c++) {
+        audio->gains[c][0] = Vega_AudioGain(backend.channels ? backend.channels[c].left : 1.0f);
+        audio->gains[c][1] = Vega_AudioGain(backend.channels ? backend.channels[c].right : 1.0f);
+    }
+    if (mode == VEGA_AUDMODE_DEVICE && !Vega_AudioOpenDevice()) mode = VEGA_AUDMODE_HEADLESS;
+    audio->audioMode = mode;
+    if (!Vega_AudioAllocBuffers()) {
+        Vega_AudioCloseDevice();
+        return;
+    }
+    if (audio->audioBackend.initCB) audio->audioBackend.initCB();
+#if RENDER_SDL
+    if (audio->device) SDL_PauseAudioDevice(audio->device, 0);
+#endif
+}
+
+void Vega_AudioDeinit() {
+    Vega_AudioCloseDevice();
+    Vega_AudioCloseSink();
+    if (audio->ring && audio->audioBackend.deinitCB) audio->audioBackend.deinitCB();
+    Vega_AudioFreeBuffers();
+}
+
+static void Vega_AudioPutLE(u8 * dst, u32 value, u8 bytes) {
+    for (u8 i = 0; i < bytes; i++) dst[i] = (u8)(value >> (i * 8));
+}
+
+static void Vega_AudioWriteWAVHeader(u32 dataBytes) {
+    u32 rate = audio->audioBackend.outputRate;
+    u8 header[VEGA_AUDIO_WAVHEADER];
+    memcpy(&header[0], "RIFF", 4);
+    Vega_AudioPutLE(&header[4], dataBytes + VEGA_AUDIO_WAVHEADER - 8, 4);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    Vega_AudioPutLE(&header[16], 16, 4); // Format chunk size.
+    Vega_AudioPutLE(&header[20], 1, 2); // PCM.
+    Vega_AudioPutLE(&header[22], 2, 2); // Channels.
+    Vega_AudioPutLE(&header[24], rate, 4);
+    Vega_AudioPutLE(&header[28], rate * 4, 4); // Bytes per second.
+    Vega_AudioPutLE(&header[32], 4, 2); // Bytes per frame.
+    Vega_AudioPutLE(&header[34], 16, 2); // Bits per sample.
+    memcpy(&header[36], "data", 4);
+    Vega_AudioPutLE(&header[40], dataBytes, 4);
+    if (fwrite(header, 1, sizeof(header), audio->sink) != sizeof(header)) perror("audio sink write");
+}
+
+bool8 Vega_AudioOpenSink(const char * path, VegaAudioSinkFormat format) {
+    Vega_AudioCloseSink();
+    if (!audio->ring || audio->device) return false;
+    audio->sink = fopen(path, "wb");
+    if (!audio->sink) {
+        perror("audio sink");
+        return false;
+    }
+    audio->sinkFormat = format;
+    audio->sinkBytes = 0;
+    if (format == VEGA_AUDSINK_WAV) Vega_AudioWriteWAVHeader(0); // Rewritten with the real sizes on close.
+    return true;
+}
+
+void Vega_AudioCloseSink() {
+    FILE * sink = audio->sink;
+    if (!sink) return;
+    if (audio->sinkFormat == VEGA_AUDSINK_WAV && !fseek(sink, 0, SEEK_SET)) Vega_AudioWriteWAVHeader((u32)((audio->sinkBytes > UINT32_MAX - VEGA_AUDIO_WAVHEADER) ? UINT32_MAX - VEGA_AUDIO_WAVHEADER : audio->sinkBytes));
+    audio->sink = NULL;
+    if (fclose(sink)) perror("audio sink close");
+}
+
+static void Vega_AudioDrainSink() {
+    s16 frames[2048];
+    u32 count;
+    while ((count = Vega_AudioPop(audio, frames, sizeof(frames) / 4))) {
+        if (fwrite(frames, 4, count, audio->sink) != count) {
+            perror("audio sink write");
+            Vega_AudioCloseSink();
+            return;
+        }
+        audio->sinkBytes += (u64)count * 4;
+    }
+}
+
+void Vega_AudioAdvance(u32 frames) {
+    const VegaAudioBackend * backend = &audio->audioBackend;
+    u64 start;
+    u32 count;
+    if (!audio->ring) return;
+    Vega_TraceBegin(VEGA_TRACE_AUDIO, 0);
+    start = Vega_AudioNow();
+    while (frames) {
+        count = (frames < backend->blockSize) ? frames : backend->blockSize;
+        memset(audio->mixAcc[0], 0, sizeof(s32) * count);
+        memset(audio->mixAcc[1], 0, sizeof(s32) * count);
+        if (backend->generateCB) {
+            for (u8 c = 0; c < backend->channelCount; c++) {
+                backend->generateCB(c, audio->channelBuf, count);
+                Vega_Simd.mixChannel(audio->mixAcc[0], audio->mixAcc[1], audio->channelBuf, audio->gains[c][0], audio->gains[c][1], count);
+            }
+        }
+        Vega_Simd.narrowMix(&audio->history[0][audio->historyFill], audio->mixAcc[0], count);
+        Vega_Simd.narrowMix(&audio->history[1][audio->historyFill], audio->mixAcc[1], count);
+        audio->historyFill += count;
+        Vega_AudioPush(audio->outBuf, Vega_AudioResample());
+        audio->audioStats.framesGenerated += count;
+        frames -= count;
+    }
+    audio->audioStats.mixTime += Vega_AudioNow() - start;
+    Vega_TraceEnd(VEGA_TRACE_AUDIO);
+    if (audio->sink) Vega_AudioDrainSink();
+}
+
+void Vega_AudioSetChannelGain(u8 channel, float left, float right) {
+    if (channel >= VEGA_AUDIO_MAXCHANNELS) return;
+    audio->gains[channel][0] = Vega_AudioGain(left);
+    audio->gains[channel][1] = Vega_AudioGain(right);
+}
+
+u32 Vega_AudioRead(s16 * dst, u32 frames) {
+    if (!audio->ring || audio->device || audio->sink) return 0;
+    return Vega_AudioPop(audio, dst, frames);
+}
+
+u32 Vega_AudioGetQueued() {
+    if (!audio->ring) return 0;
+    return __atomic_load_n(&audio->ringTail, __ATOMIC_ACQUIRE) - __atomic_load_n(&audio->ringHead, __ATOMIC_ACQUIRE);
+}
+
+u32 Vega_AudioGetOutputRate() {
+    return audio->audioBackend.outputRate;
+}
+
+void Vega_AudioGetStats(VegaAudioStats * stats) {
+    *stats = audio->audioStats;
+    stats->underruns = __atomic_load_n(&audio->underruns, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,165 @@
+/*
+    Vega Engine static backend header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_BACKEND_H
+#define VEGA_BACKEND_H 1
+
+#include "../include/vegatypes.h"
+#include "../include/vegavideo.h"
+
+// The renderer reads the backend through these macros. By default they expand to the VegaVideoBackend passed at init, building with
+// VEGA_STATIC_BACKEND set to a quoted header path (make static VEGA_BACKEND=...) specializes it for that one backend instead: any of
+// the following the header defines replaces the matching field, with a constant or with a static inline function the compiler can
+// inline into the render loops.
+//   Constants: VEGA_STATIC_SCREENW, VEGA_STATIC_PLANECOUNT, VEGA_STATIC_TILECOUNT, VEGA_STATIC_COLORDEPTH,
+//              VEGA_STATIC_PALETTEDEPTH, VEGA_STATIC_PRIORITYDEPTH.
+//   Callbacks: VEGA_STATIC_GETTILECOLOR, VEGA_STATIC_GETPLANETILEID, VEGA_STATIC_GETPLANETILEPALETTE, VEGA_STATIC_GETPLANETILEPRIORITY,
+//              VEGA_STATIC_GETPLANEVSCROLL, VEGA_STATIC_GETPLANELINE, VEGA_STATIC_GETSPRITECOLOR, VEGA_STATIC_SHOULDBLANKPIXEL.
+// The backend still passes a complete VegaVideoBackend to Vega_VideoInitMode, the rest of the engine calls through it, and init
+// fails if its constants differ from the header's. bench/vegastatic.h is an example, make static-bench checks it renders the same
+// frames both ways.
+#if defined(VEGA_STATIC_BACKEND)
+#include VEGA_STATIC_BACKEND
+#endif
+
+#ifdef VEGA_STATIC_SCREENW
+#define VEGA_BACKEND_SCREENW(v) ((u16)(VEGA_STATIC_SCREENW))
+#else
+#define VEGA_BACKEND_SCREENW(v) ((v)->videoBackend.screenW)
+#endif
+
+#ifdef VEGA_STATIC_PLANECOUNT
+#define VEGA_BACKEND_PLANECOUNT(v) ((u8)(VEGA_STATIC_PLANECOUNT))
+#else
+#define VEGA_BACKEND_PLANECOUNT(v) ((v)->videoBackend.planeCount)
+#endif
+
+#ifdef VEGA_STATIC_TILECOUNT
+#define VEGA_BACKEND_TILECOUNT(v) ((u16)(VEGA_STATIC_TILECOUNT))
+#else
+#define VEGA_BACKEND_TILECOUNT(v) ((v)->videoBackend.tileCount)
+#endif
+
+#ifdef VEGA_STATIC_COLORDEPTH
+#define VEGA_BACKEND_COLORDEPTH(v) ((VegaVideoIndexDepth)(VEGA_STATIC_COLORDEPTH))
+#else
+#define VEGA_BACKEND_COLORDEPTH(v) ((v)->videoBackend.colorIndexDepth)
+#endif
+
+#ifdef VEGA_STATIC_PALETTEDEPTH
+#define VEGA_BACKEND_PALETTEDEPTH(v) ((VegaVideoIndexDepth)(VEGA_STATIC_PALETTEDEPTH))
+#else
+#define VEGA_BACKEND_PALETTEDEPTH(v) ((v)->videoBackend.paletteIndexDepth)
+#endif
+
+#ifdef VEGA_STATIC_PRIORITYDEPTH
+#define VEGA_BACKEND_PRIORITYDEPTH(v) ((VegaVideoIndexDepth)(VEGA_STATIC_PRIORITYDEPTH))
+#else
+#define VEGA_BACKEND_PRIORITYDEPTH(v) ((v)->videoBackend.priorityIndexDepth)
+#endif
+
+#ifdef VEGA_STATIC_GETTILECOLOR
+#define VEGA_BACKEND_GETTILECOLOR(v) VEGA_STATIC_GETTILECOLOR
+#else
+#define VEGA_BACKEND_GETTILECOLOR(v) (v)->videoBackend.getTileColor
+#endif
+
+#ifdef VEGA_STATIC_GETPLANETILEID
+#define VEGA_BACKEND_GETPLANETILEID(v) VEGA_STATIC_GETPLANETILEID
+#else
+#define VEGA_BACKEND_GETPLANETILEID(v) (v)->videoBackend.getPlaneTileID
+#endif
+
+#ifdef VEGA_STATIC_GETPLANETILEPALETTE
+#define VEGA_BACKEND_GETPLANETILEPALETTE(v) VEGA_STATIC_GETPLANETILEPALETTE
+#else
+#define VEGA_BACKEND_GETPLANETILEPALETTE(v) (v)->videoBackend.getPlaneTilePalette
+#endif
+
+#ifdef VEGA_STATIC_GETPLANETILEPRIORITY
+#define VEGA_BACKEND_GETPLANETILEPRIORITY(v) VEGA_STATIC_GETPLANETILEPRIORITY
+#else
+#define VEGA_BACKEND_GETPLANETILEPRIORITY(v) (v)->videoBackend.getPlaneTilePriority
+#endif
+
+#ifdef VEGA_STATIC_GETPLANEVSCROLL
+#define VEGA_BACKEND_GETPLANEVSCROLL(v) VEGA_STATIC_GETPLANEVSCROLL
+#else
+#define VEGA_BACKEND_GETPLANEVSCROLL(v) (v)->videoBackend.getPlaneVScroll
+#endif
+
+#ifdef VEGA_STATIC_GETSPRITECOLOR
+#define VEGA_BACKEND_GETSPRITECOLOR(v) VEGA_STATIC_GETSPRITECOLOR
+#else
+#define VEGA_BACKEND_GETSPRITECOLOR(v) (v)->videoBackend.getSpriteColor
+#endif
+
+// The optional callbacks also need their presence check, which is constant once the header provides them.
+#ifdef VEGA_STATIC_GETPLANELINE
+#define VEGA_BACKEND_GETPLANELINE(v) VEGA_STATIC_GETPLANELINE
+#define VEGA_BACKEND_HASPLANELINE(v) true
+#else
+#define VEGA_BACKEND_GETPLANELINE(v) (v)->videoBackend.getPlaneLine
+#define VEGA_BACKEND_HASPLANELINE(v) ((v)->videoBackend.getPlaneLine != NULL)
+#endif
+
+#ifdef VEGA_STATIC_SHOULDBLANKPIXEL
+#define VEGA_BACKEND_SHOULDBLANKPIXEL(v) VEGA_STATIC_SHOULDBLANKPIXEL
+#define VEGA_BACKEND_HASBLANKPIXEL(v) true
+#else
+#define VEGA_BACKEND_SHOULDBLANKPIXEL(v) (v)->videoBackend.shouldBlankPixel
+#define VEGA_BACKEND_HASBLANKPIXEL(v) ((v)->videoBackend.shouldBlankPixel != NULL)
+#endif
+
+static inline bool8 Vega_BackendMatchesStatic(const VegaVideoBackend * backend) { // Always true in the generic build.
+    bool8 match = true;
+    (void)backend;
+#ifdef VEGA_STATIC_SCREENW
+    match &= backend->screenW == VEGA_STATIC_SCREENW;
+#endif
+#ifdef VEGA_STATIC_PLANECOUNT
+    match &= backend->planeCount == VEGA_STATIC_PLANECOUNT;
+#endif
+#ifdef VEGA_STATIC_TILECOUNT
+    match &= backend->tileCount == VEGA_STATIC_TILECOUNT;
+#endif
+#ifdef VEGA_STATIC_COLORDEPTH
+    match &= backend->colorIndexDepth == VEGA_STATIC_COLORDEPTH;
+#endif
+#ifdef VEGA_STATIC_PALETTEDEPTH
+    match &= backend->paletteIndexDepth == VEGA_STATIC_PALETTEDEPTH;
+#endif
+#ifdef VEGA_STATIC_PRIORITYDEPTH
+    match &= backend->priorityIndexDepth == VEGA_STATIC_PRIORITYDEPTH;
+#endif
+#ifdef VEGA_STATIC_GETPLANELINE
+    match &= backend->getPlaneLine != NULL;
+#endif
+#ifdef VEGA_STATIC_SHOULDBLANKPIXEL
+    match &= backend->shouldBlankPixel != NULL;
+#endif
+    return match;
+}
+
+#endif
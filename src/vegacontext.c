@@ -0,0 +1,76 @@
+/*
+    Vega Engine context sources.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define VEGA_INTERNAL 1
+#include "../include/vega.h"
+
+struct VegaContext {
+    VegaVideoState * video;
+    VegaIOState * io;
+    VegaAudioState * audio;
+};
+
+static __thread VegaContext * current = NULL;
+
+VegaContext * Vega_ContextCreate() {
+    VegaContext * ctx = malloc(sizeof(VegaContext));
+    if (!ctx) {
+        perror("context allocation");
+        return NULL;
+    }
+    ctx->video = Vega_VideoCreateState(ctx);
+    ctx->io = Vega_IOCreateState();
+    ctx->audio = Vega_AudioCreateState();
+    if (!ctx->video || !ctx->io || !ctx->audio) {
+        Vega_VideoDestroyState(ctx->video);
+        Vega_IODestroyState(ctx->io);
+        Vega_AudioDestroyState(ctx->audio);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void Vega_ContextDestroy(VegaContext * ctx) {
+    if (!ctx) return;
+    if (current == ctx) Vega_ContextMakeCurrent(NULL);
+    Vega_VideoDestroyState(ctx->video);
+    Vega_IODestroyState(ctx->io);
+    Vega_AudioDestroyState(ctx->audio);
+    free(ctx);
+}
+
+void Vega_ContextMakeCurrent(VegaContext * ctx) {
+    current = ctx;
+    Vega_VideoBindState(ctx ? ctx->video : NULL);
+    Vega_IOBindState(ctx ? ctx->io : NULL);
+    Vega_AudioBindState(ctx ? ctx->audio : NULL);
+}
+
+VegaContext * Vega_ContextGetCurrent() {
+    return current;
+}
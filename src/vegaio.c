@@ -26,39 +26,155 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <sched.h>
+
+#define VEGA_INTERNAL 1
 #include "../include/vega.h"
 
-static VegaRegister * regArray;
-static u8 regCount;
+typedef struct VegaIOQueueEntry {
+    u64 time;
+    u8 id;
+    bool8 isCmd;
+    VegaAccessSize size;
+    u32 val;
+    VegaCommand cmd;
+} VegaIOQueueEntry;
+
+struct VegaIOState { // Everything one context's IO subsystem keeps between calls.
+    VegaRegister * regArray;
+    u8 regCount;
+    VegaIOQueueEntry * ioQueue; // Ring of queued writes and commands, NULL when running synchronously.
+    u32 ioQueueMask;
+    u64 ioQueueTime; // Producer side.
+    const u8 * ioQueueConsumer; // ioThreadTag of the thread that last drained the queue, or NULL before the first drain.
+    u32 ioQueueTail __attribute__((aligned(64))); // Written by the producer only.
+    u32 ioQueueHead __attribute__((aligned(64))); // Written by the consumer only.
+    VegaBusRegion * busRegions;
+    u16 busRegionCount;
+    VegaBusState bus;
+};
+
+static VegaIOState ioDefault;
+static __thread VegaIOState * io __attribute__((tls_model("initial-exec"))) = &ioDefault; // The state of the context bound to the calling thread.
+__thread VegaBusState * Vega_IOBus __attribute__((tls_model("initial-exec"))) = &ioDefault.bus;
+static __thread u8 ioThreadTag; // Only its address is used, to tell threads apart.
 
 void Vega_IOInit(const VegaRegister * regs, u8 count) {
-    regArray = malloc(sizeof(VegaRegister)*count);
-    if (!regArray) perror("io register allocation");
-    memcpy(regArray, regs, sizeof(VegaRegister)*count);
-    regCount = count;
+    io->regArray = malloc(sizeof(VegaRegister)*count);
+    if (!io->regArray) perror("io register allocation");
+    memcpy(io->regArray, regs, sizeof(VegaRegister)*count);
+    io->regCount = count;
 }
 
 void Vega_IODeinit() {
-    free(regArray);
+    Vega_IOSetAsync(0);
+    free(io->regArray);
+}
+
+VegaIOState * Vega_IOCreateState() {
+    VegaIOState * state;
+    if (posix_memalign((void **)&state, 64, sizeof(VegaIOState))) { // Keeps the queue indices on their own cache lines.
+        perror("io state allocation");
+        return NULL;
+    }
+    memset(state, 0, sizeof(VegaIOState));
+    return state;
+}
+
+void Vega_IODestroyState(VegaIOState * state) { // The state must be deinitialized and bound to no other thread.
+    if (!state || state == &ioDefault) return;
+    if (io == state) Vega_IOBindState(NULL);
+    free(state);
+}
+
+void Vega_IOBindState(VegaIOState * state) {
+    io = state ? state : &ioDefault;
+    Vega_IOBus = &io->bus;
 }
 
 u8 Vega_IOGetRegCount() {
-    return regCount;
+    return io->regCount;
+}
+
+static void Vega_IOQueueRun(const VegaIOQueueEntry * entry) {
+    if (entry->isCmd) {
+        if (io->regArray[entry->id].cmdCB) io->regArray[entry->id].cmdCB(entry->cmd);
+    } else {
+        if (io->regArray[entry->id].writeCB) io->regArray[entry->id].writeCB(entry->val, entry->size);
+    }
+}
+
+static void Vega_IOQueuePush(const VegaIOQueueEntry * entry) {
+    u32 head, tail = io->ioQueueTail;
+    while (tail - (head = __atomic_load_n(&io->ioQueueHead, __ATOMIC_ACQUIRE)) > io->ioQueueMask) { // Full.
+        if (__atomic_load_n(&io->ioQueueConsumer, __ATOMIC_ACQUIRE) != &ioThreadTag) {
+            sched_yield(); // Wait for the consumer to catch up.
+            continue;
+        }
+        Vega_IOQueueRun(&io->ioQueue[head & io->ioQueueMask]); // The consumer would wait on itself, so the oldest entry runs early instead.
+        __atomic_store_n(&io->ioQueueHead, head + 1, __ATOMIC_RELEASE);
+    }
+    io->ioQueue[tail & io->ioQueueMask] = *entry;
+    __atomic_store_n(&io->ioQueueTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void Vega_IOSetAsync(u32 capacity) {
+    u32 size = 1;
+    if (io->ioQueue) Vega_IODrain(UINT64_MAX);
+    free(io->ioQueue);
+    io->ioQueue = NULL;
+    io->ioQueueMask = 0;
+    io->ioQueueHead = io->ioQueueTail = 0;
+    io->ioQueueConsumer = NULL;
+    if (!capacity) return;
+    while (size < capacity) size <<= 1;
+    io->ioQueue = malloc(size * sizeof(VegaIOQueueEntry));
+    if (!io->ioQueue) {
+        perror("io command queue allocation");
+        return;
+    }
+    io->ioQueueMask = size - 1;
+}
+
+bool8 Vega_IOIsAsync() {
+    return io->ioQueue != NULL;
+}
+
+void Vega_IOSetTime(u64 time) {
+    io->ioQueueTime = time;
+}
+
+u32 Vega_IODrain(u64 time) {
+    u32 head, tail, count = 0;
+    const VegaIOQueueEntry * entry;
+    if (!io->ioQueue) return 0;
+    if (io->ioQueueConsumer != &ioThreadTag) __atomic_store_n(&io->ioQueueConsumer, &ioThreadTag, __ATOMIC_RELEASE);
+    head = io->ioQueueHead;
+    tail = __atomic_load_n(&io->ioQueueTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++, count++) {
+        entry = &io->ioQueue[head & io->ioQueueMask];
+        if (entry->time > time) break;
+        Vega_IOQueueRun(entry);
+        __atomic_store_n(&io->ioQueueHead, head + 1, __ATOMIC_RELEASE); // Freed one at a time so a waiting producer can go on while callbacks run.
+    }
+    return count;
 }
 
 u32 Vega_IORegRead(u8 id, VegaAccessSize size) {
-    if (id >= regCount || !regArray[id].readCB) return 0;
-    else return regArray[id].readCB(size);
+    if (id >= io->regCount || !io->regArray[id].readCB) return 0;
+    else return io->regArray[id].readCB(size);
 }
 
 void Vega_IORegWrite(u8 id, u32 val, VegaAccessSize size) {
-    if (id >= regCount || !regArray[id].writeCB) return;
-    regArray[id].writeCB(val, size);
+    if (id >= io->regCount || !io->regArray[id].writeCB) return;
+    if (io->ioQueue) Vega_IOQueuePush(&(VegaIOQueueEntry){.time=io->ioQueueTime, .id=id, .isCmd=false, .size=size, .val=val});
+    else io->regArray[id].writeCB(val, size);
 }
 
 void Vega_IORegCmd(u8 id, VegaCommand cmd) {
-    if (id >= regCount || !regArray[id].cmdCB) return;
-    regArray[id].cmdCB(cmd);
+    if (id >= io->regCount || !io->regArray[id].cmdCB) return;
+    if (io->ioQueue) Vega_IOQueuePush(&(VegaIOQueueEntry){.time=io->ioQueueTime, .id=id, .isCmd=true, .cmd=cmd});
+    else io->regArray[id].cmdCB(cmd);
 }
 
 void Vega_IORegPCmd(u8 id, u8 cmdid, void * ptr, u32 size) {
@@ -85,4 +201,215 @@ void Vega_IORegBCmd(u8 id, u8 cmdid, u8 * data, u8 len) {
     u8 n = (sizeof(void *) + sizeof(u32)) < (len) ? (sizeof(void *) + sizeof(u32)) : (len);
     memcpy(cmd.datab, data, n);
     Vega_IORegCmd(id, cmd);
+}
+
+static void Vega_IOBusMapPages(u32 first, u32 last) { // Rebuilds the page table entries FIRST to LAST from the regions covering them.
+    u64 pageStart, pageSize = (u64)1 << io->bus.pageBits;
+    u32 page, off;
+    u16 i;
+    const VegaBusRegion * region;
+    VegaBusPage * entry;
+    for (page = first; page <= last; page++) {
+        entry = &io->bus.pages[page];
+        pageStart = (u64)page << io->bus.pageBits;
+        entry->read = entry->write = NULL;
+        entry->region = VEGA_BUSPAGE_UNMAPPED;
+        for (i = io->busRegionCount; i--;) { // The newest region covering the whole page hides everything mapped before it.
+            region = &io->busRegions[i];
+            if (pageStart + pageSize <= region->start || pageStart >= (u64)region->start + region->size) continue;
+            if (pageStart < region->start || pageStart + pageSize > (u64)region->start + region->size) {
+                entry->region = VEGA_BUSPAGE_SHARED;
+                break;
+            }
+            entry->region = i;
+            break;
+        }
+        if (entry->region >= VEGA_BUSPAGE_SHARED) continue;
+        region = &io->busRegions[entry->region];
+        if (!region->mem || region->access || !region->memSize) continue;
+        off = (u32)((pageStart - region->start) % region->memSize);
+        if (off + pageSize > region->memSize) continue; // The page wraps around a mirror, so it goes through the slow path.
+        entry->read = region->mem + off;
+        if (!region->readOnly) entry->write = entry->read;
+    }
+}
+
+void Vega_IOBusInit(u8 addrBits, u8 pageBits, bool8 bigEndian) {
+    if (addrBits > 32) addrBits = 32;
+    if (pageBits > addrBits) pageBits = addrBits;
+    if (pageBits > 30) pageBits = 30; // Keeps page sizes and page table lengths representable in a u32.
+    if (pageBits < 2) pageBits = 2; // Long accesses have to fit in a page for the fast path.
+    io->bus.addrMask = (addrBits == 32) ? UINT32_MAX : (1u << addrBits) - 1;
+    io->bus.pageBits = pageBits;
+    io->bus.pageMask = (1u << pageBits) - 1;
+    io->bus.bigEndian = bigEndian;
+    io->bus.pages = malloc(((u64)(io->bus.addrMask >> pageBits) + 1) * sizeof(VegaBusPage));
+    if (!io->bus.pages) perror("io bus page table allocation");
+    io->busRegions = NULL;
+    io->busRegionCount = 0;
+    Vega_IOBusMapPages(0, io->bus.addrMask >> pageBits);
+}
+
+void Vega_IOBusDeinit() {
+    free(io->bus.pages);
+    free(io->busRegions);
+    io->bus.pages = NULL;
+    io->busRegions = NULL;
+    io->busRegionCount = 0;
+}
+
+static inline bool8 Vega_IOBusHides(const VegaBusRegion * region, u32 start, u64 end) { // Whether START to END covers all of REGION.
+    return region->start >= start && (u64)region->start + region->size - 1 <= end;
+}
+
+static void Vega_IOBusRenumber(u16 from, u16 to) { // Points the pages of the region moved from index FROM to index TO at it.
+    const VegaBusRegion * region = &io->busRegions[to];
+    u32 page, last = (u32)(((u64)region->start + region->size - 1) >> io->bus.pageBits);
+    for (page = region->start >> io->bus.pageBits; page <= last; page++) {
+        if (io->bus.pages[page].region == from) io->bus.pages[page].region = to;
+    }
+}
+
+bool8 Vega_IOBusMap(VegaBusRegion region) {
+    u64 end;
+    u16 i, kept = 0, hidden = 0;
+    bool8 overlaps = false, append;
+    VegaBusRegion * regions;
+    if (!region.size || region.start > io->bus.addrMask) return false;
+    end = (u64)region.start + region.size - 1;
+    if (end > io->bus.addrMask) {
+        end = io->bus.addrMask;
+        region.size = (u32)(end - region.start + 1);
+    }
+    if (region.mem && !region.memSize) region.memSize = region.size;
+    for (i = 0; i < io->busRegionCount; i++) {
+        if (Vega_IOBusHides(&io->busRegions[i], region.start, end)) hidden++;
+        else overlaps |= io->busRegions[i].start <= end && region.start <= (u64)io->busRegions[i].start + io->busRegions[i].size - 1;
+    }
+    append = region.mem || region.regCount || overlaps; // A region with neither memory nor registers only matters over an older one.
+    if (append && !hidden) {
+        if (io->busRegionCount >= VEGA_BUSPAGE_SHARED) return false;
+        regions = realloc(io->busRegions, (io->busRegionCount + 1) * sizeof(VegaBusRegion));
+        if (!regions) {
+            perror("io bus region allocation");
+            return false;
+        }
+        io->busRegions = regions;
+    }
+    for (i = 0; i < io->busRegionCount; i++) { // Regions the new one hides completely are dropped, so switching banks doesn't grow the list.
+        if (Vega_IOBusHides(&io->busRegions[i], region.start, end)) continue;
+        if (kept != i) {
+            io->busRegions[kept] = io->busRegions[i];
+            Vega_IOBusRenumber(i, kept);
+        }
+        kept++;
+    }
+    io->busRegionCount = kept;
+    if (append) io->busRegions[io->busRegionCount++] = region;
+    Vega_IOBusMapPages(region.start >> io->bus.pageBits, (u32)(end >> io->bus.pageBits));
+    return true;
+}
+
+bool8 Vega_IOBusUnmap(u32 start, u32 size) {
+    return Vega_IOBusMap((VegaBusRegion){.start=start, .size=size}); // A region with neither memory nor registers reads 0 and drops writes.
+}
+
+static const VegaBusRegion * Vega_IOBusFindRegion(u32 addr) {
+    u16 i, index = io->bus.pages[addr >> io->bus.pageBits].region;
+    if (index == VEGA_BUSPAGE_UNMAPPED) return NULL;
+    if (index != VEGA_BUSPAGE_SHARED) return &io->busRegions[index];
+    for (i = io->busRegionCount; i--;) {
+        if (addr - io->busRegions[i].start < io->busRegions[i].size) return &io->busRegions[i];
+    }
+    return NULL;
+}
+
+static inline u8 Vega_IOBusRegOf(const VegaBusRegion * region, u32 addr) {
+    return region->reg + (u8)(((addr - region->start) % ((u32)region->regCount * region->regStride)) / region->regStride);
+}
+
+u32 Vega_IOBusSlowRead(u32 addr, VegaAccessSize size) {
+    const VegaBusRegion * region = Vega_IOBusFindRegion(addr);
+    u32 val = 0, i, at;
+    u8 byte;
+    if (!region || (region->access && !(region->access & (1u << size)))) return 0;
+    if (region->mem) {
+        if (size == ACCESS_BYTE) return region->mem[(addr - region->start) % region->memSize];
+        for (i = 0; i < (1u << size); i++) { // Each byte may be in another mirror, page or region. Bytes of this one skip its access check.
+            at = (addr + i) & io->bus.addrMask;
+            byte = (Vega_IOBusFindRegion(at) == region) ? region->mem[(at - region->start) % region->memSize] : Vega_IOBusRead8(at);
+            if (io->bus.bigEndian) val = (val << 8) | byte;
+            else val |= (u32)byte << (i * 8);
+        }
+        return val;
+    }
+    if (!region->regCount || !region->regStride) return 0;
+    return Vega_IORegRead(Vega_IOBusRegOf(region, addr), size);
+}
+
+void Vega_IOBusSlowWrite(u32 addr, u32 val, VegaAccessSize size) {
+    const VegaBusRegion * region = Vega_IOBusFindRegion(addr);
+    u32 i, at;
+    u8 byte;
+    if (!region || (region->access && !(region->access & (1u << size)))) return;
+    if (region->mem) {
+        if (region->readOnly) return;
+        if (size == ACCESS_BYTE) {
+            region->mem[(addr - region->start) % region->memSize] = (u8)val;
+            return;
+        }
+        for (i = 0; i < (1u << size); i++) {
+            byte = (u8)(val >> ((io->bus.bigEndian ? (1u << size) - 1 - i : i) * 8));
+            at = (addr + i) & io->bus.addrMask;
+            if (Vega_IOBusFindRegion(at) == region) region->mem[(at - region->start) % region->memSize] = byte;
+            else Vega_IOBusWrite8(at, byte);
+        }
+        return;
+    }
+    if (!region->regCount || !region->regStride) return;
+    Vega_IORegWrite(Vega_IOBusRegOf(region, addr), val, size);
+}
+
+void Vega_IOBusReadBlock(u32 addr, void * dst, u32 len) {
+    u8 * out = dst;
+    u32 n;
+    const VegaBusPage * page;
+    while (len) {
+        addr &= io->bus.addrMask;
+        page = &io->bus.pages[addr >> io->bus.pageBits];
+        n = (io->bus.pageMask - (addr & io->bus.pageMask)) + 1;
+        if (n > len) n = len;
+        if (page->read) {
+            memcpy(out, &page->read[addr & io->bus.pageMask], n);
+        } else {
+            for (u32 i = 0; i < n; i++) {
+                out[i] = (u8)Vega_IOBusSlowRead(addr + i, ACCESS_BYTE);
+            }
+        }
+        out += n;
+        addr += n;
+        len -= n;
+    }
+}
+
+void Vega_IOBusWriteBlock(u32 addr, const void * src, u32 len) {
+    const u8 * in = src;
+    u32 n;
+    const VegaBusPage * page;
+    while (len) {
+        addr &= io->bus.addrMask;
+        page = &io->bus.pages[addr >> io->bus.pageBits];
+        n = (io->bus.pageMask - (addr & io->bus.pageMask)) + 1;
+        if (n > len) n = len;
+        if (page->write) {
+            memcpy(&page->write[addr & io->bus.pageMask], in, n);
+        } else {
+            for (u32 i = 0; i < n; i++) {
+                Vega_IOBusSlowWrite(addr + i, in[i], ACCESS_BYTE);
+            }
+        }
+        in += n;
+        addr += n;
+        len -= n;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,58 @@
+/*
+    Vega Engine output stage sources.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "../include/vega.h"
+#include "vegasimd.h"
+
+static inline u8 Vega_VideoOutputScale(VegaVideoOutput output) {
+    if (!output.scale) return 1;
+    return (output.scale > VEGA_VIDOUT_MAXSCALE) ? VEGA_VIDOUT_MAXSCALE : output.scale;
+}
+
+u32 Vega_VideoGetOutputPitch(VegaVideoOutput output, u16 w) {
+    return (u32)w * Vega_VideoOutputScale(output) * ((output.format == VEGA_VIDFMT_RGB565) ? 2 : 4);
+}
+
+void Vega_VideoConvertFrame(VegaVideoOutput output, void * dst, u32 dstPitch, const VegaVideoColor * src, u32 srcPitch, u16 w, u16 h) {
+    u8 scale = Vega_VideoOutputScale(output), size = (output.format == VEGA_VIDFMT_RGB565) ? 2 : 4, k;
+    u32 row, bytes = Vega_VideoGetOutputPitch(output, w);
+    u8 * block;
+    const VegaVideoColor * line;
+    Vega_SimdInit();
+    for (row = 0; row < h; row++) {
+        line = (const VegaVideoColor *)((const u8 *)src + (row * srcPitch));
+        block = (u8 *)dst + ((u64)row * scale * dstPitch);
+        if (scale == 1) {
+            Vega_Simd.convertLine(block, line, w, output.format);
+            continue;
+        }
+        Vega_Simd.convertLine(block + ((scale - 1) * dstPitch), line, w, output.format); // The block's last row is free until the first one is filled.
+        Vega_Simd.expandLine(block, block + ((scale - 1) * dstPitch), w, scale, size);
+        for (k = 1; k < scale - 1; k++) memcpy(block + (k * dstPitch), block, bytes);
+        if (output.scanlines) Vega_Simd.darkenLine(block + ((scale - 1) * dstPitch), block, w * scale, size);
+        else memcpy(block + ((scale - 1) * dstPitch), block, bytes);
+    }
+}
@@ -0,0 +1,129 @@
+/*
+    Vega Engine event scheduler sources.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vegasched.h"
+
+#define VEGA_SCHED_SLOTBITS 24 // Event IDs keep the slot in their low bits and a serial above, so a stale ID never matches a reused slot.
+#define VEGA_SCHED_MAXSLOTS (1u << VEGA_SCHED_SLOTBITS)
+
+static inline bool8 Vega_SchedBefore(const VegaScheduler * sched, u32 a, u32 b) {
+    const VegaEvent * x = &sched->events[a], * y = &sched->events[b];
+    return (x->time < y->time) || (x->time == y->time && x->id < y->id);
+}
+
+static inline void Vega_SchedPlace(VegaScheduler * sched, u32 pos, u32 slot) {
+    sched->heap[pos] = slot;
+    sched->events[slot].link = pos;
+}
+
+static void Vega_SchedSiftUp(VegaScheduler * sched, u32 pos) {
+    u32 slot = sched->heap[pos], parent;
+    while (pos) {
+        parent = (pos - 1) >> 1;
+        if (!Vega_SchedBefore(sched, slot, sched->heap[parent])) break;
+        Vega_SchedPlace(sched, pos, sched->heap[parent]);
+        pos = parent;
+    }
+    Vega_SchedPlace(sched, pos, slot);
+}
+
+static void Vega_SchedSiftDown(VegaScheduler * sched, u32 pos) {
+    u32 slot = sched->heap[pos], child;
+    while ((child = (pos << 1) + 1) < sched->count) {
+        if (child + 1 < sched->count && Vega_SchedBefore(sched, sched->heap[child + 1], sched->heap[child])) child++;
+        if (!Vega_SchedBefore(sched, sched->heap[child], slot)) break;
+        Vega_SchedPlace(sched, pos, sched->heap[child]);
+        pos = child;
+    }
+    Vega_SchedPlace(sched, pos, slot);
+}
+
+static void Vega_SchedRemoveAt(VegaScheduler * sched, u32 pos) {
+    u32 slot = sched->heap[pos];
+    sched->events[slot].id = 0;
+    sched->events[slot].link = sched->freeSlot;
+    sched->freeSlot = slot;
+    if (pos != --sched->count) {
+        Vega_SchedPlace(sched, pos, sched->heap[sched->count]);
+        if (pos && Vega_SchedBefore(sched, sched->heap[pos], sched->heap[(pos - 1) >> 1])) Vega_SchedSiftUp(sched, pos);
+        else Vega_SchedSiftDown(sched, pos);
+    }
+}
+
+static bool8 Vega_SchedGrow(VegaScheduler * sched) {
+    u32 cap = sched->cap ? sched->cap * 2 : 64, i;
+    VegaEvent * events;
+    u32 * heap;
+    if (cap > VEGA_SCHED_MAXSLOTS) return false;
+    events = realloc(sched->events, cap * sizeof(VegaEvent));
+    if (events) sched->events = events;
+    heap = realloc(sched->heap, cap * sizeof(u32));
+    if (heap) sched->heap = heap;
+    if (!events || !heap) {
+        perror("video event allocation");
+        return false;
+    }
+    for (i = sched->cap; i < cap; i++) {
+        events[i].id = 0;
+        events[i].link = i + 1;
+    }
+    sched->freeSlot = sched->cap;
+    sched->cap = cap;
+    return true;
+}
+
+VegaVideoEventID Vega_SchedAdd(VegaScheduler * sched, u64 time, VegaVideoEventCB cb, void * data) {
+    u32 slot;
+    if (sched->freeSlot >= sched->cap && !Vega_SchedGrow(sched)) return 0;
+    slot = sched->freeSlot;
+    sched->freeSlot = sched->events[slot].link;
+    sched->events[slot] = (VegaEvent){.time=time, .id=(++sched->serial << VEGA_SCHED_SLOTBITS) | slot, .cb=cb, .data=data};
+    sched->heap[sched->count] = slot;
+    Vega_SchedSiftUp(sched, sched->count++);
+    return sched->events[slot].id;
+}
+
+bool8 Vega_SchedCancel(VegaScheduler * sched, VegaVideoEventID id) {
+    u32 slot = (u32)(id & (VEGA_SCHED_MAXSLOTS - 1));
+    if (!id || slot >= sched->cap || sched->events[slot].id != id) return false;
+    Vega_SchedRemoveAt(sched, sched->events[slot].link);
+    return true;
+}
+
+bool8 Vega_SchedPop(VegaScheduler * sched, u64 limit, VegaEvent * event) {
+    if (!sched->count || sched->events[sched->heap[0]].time > limit) return false;
+    *event = sched->events[sched->heap[0]];
+    Vega_SchedRemoveAt(sched, 0);
+    return true;
+}
+
+void Vega_SchedFree(VegaScheduler * sched) {
+    free(sched->events);
+    free(sched->heap);
+    memset(sched, 0, sizeof(VegaScheduler));
+}
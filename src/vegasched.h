@@ -0,0 +1,57 @@
+/*
+    Vega Engine event scheduler header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_SCHED_H
+#define VEGA_SCHED_H 1
+
+#include "../include/vegatypes.h"
+#include "../include/vegavideo.h"
+
+typedef struct VegaEvent {
+    u64 time;
+    VegaVideoEventID id; // 0 while the slot is free.
+    VegaVideoEventCB cb;
+    void * data;
+    u32 link; // Position in the heap, or the next free slot while the slot is free.
+} VegaEvent;
+
+typedef struct VegaScheduler { // Binary min-heap of pending events, ordered by time and then by when they were scheduled.
+    VegaEvent * events; // Slots, addressed by the low bits of an event ID.
+    u32 * heap; // Slot indices.
+    u32 count;
+    u32 cap;
+    u32 freeSlot; // Head of the free slot list, or cap if every slot is taken.
+    u64 serial;
+} VegaScheduler;
+
+VegaVideoEventID Vega_SchedAdd(VegaScheduler * sched, u64 time, VegaVideoEventCB cb, void * data); // Returns 0 if the event could not be stored.
+bool8 Vega_SchedCancel(VegaScheduler * sched, VegaVideoEventID id);
+bool8 Vega_SchedPop(VegaScheduler * sched, u64 limit, VegaEvent * event); // Takes the earliest event if it is due at or before LIMIT.
+void Vega_SchedFree(VegaScheduler * sched);
+
+static inline u64 Vega_SchedNext(const VegaScheduler * sched) { // Time of the earliest event, or UINT64_MAX if none is pending.
+    return sched->count ? sched->events[sched->heap[0]].time : UINT64_MAX;
+}
+
+#endif
@@ -0,0 +1,500 @@
+/*
+    Vega Engine SIMD kernels.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vegasimd.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define VEGA_SIMD_X86 1
+#endif
+
+VegaSimdKernels Vega_Simd;
+
+static void Vega_MergeLineScalar(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, const u8 * srcPrio, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        if ((src[i] & 1) && srcPrio[i] >= dstPrio[i]) {
+            dst[i] = src[i];
+            dstPrio[i] = srcPrio[i];
+        }
+    }
+}
+
+static void Vega_MergeSpanScalar(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, u8 prio, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        if ((src[i] & 1) && prio >= dstPrio[i]) {
+            dst[i] = src[i];
+            dstPrio[i] = prio;
+        }
+    }
+}
+
+static void Vega_ResolveLineScalar(VegaVideoColor * dst, const VegaVideoColor * src, VegaVideoColor clear, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        dst[i] = (src[i] & 1) ? src[i] : clear;
+    }
+}
+
+static inline u32 Vega_Widen5(u32 v) { // 5-bit channel to 8 bits, repeating the top bits so white stays white.
+    return (v << 3) | (v >> 2);
+}
+
+static void Vega_ConvertLineScalar(void * dst, const VegaVideoColor * src, u32 count, VegaVideoFormat format) {
+    u32 * out32 = dst, i, r, g, b;
+    u16 * out16 = dst;
+    for (i = 0; i < count; i++) {
+        r = src[i] >> 11;
+        g = (src[i] >> 6) & 0x1F;
+        b = (src[i] >> 1) & 0x1F;
+        switch (format) {
+            case VEGA_VIDFMT_RGBA8888: out32[i] = Vega_Widen5(r) | (Vega_Widen5(g) << 8) | (Vega_Widen5(b) << 16) | 0xFF000000u; break;
+            case VEGA_VIDFMT_BGRA8888: out32[i] = Vega_Widen5(b) | (Vega_Widen5(g) << 8) | (Vega_Widen5(r) << 16) | 0xFF000000u; break;
+            case VEGA_VIDFMT_RGB565: out16[i] = (u16)((r << 11) | (((g << 1) | (g >> 4)) << 5) | b); break;
+        }
+    }
+}
+
+static void Vega_ExpandLineScalar(void * dst, const void * src, u32 count, u8 scale, u8 size) {
+    u32 i;
+    u8 k;
+    if (size == 4) {
+        u32 * out = dst;
+        for (i = 0; i < count; i++) {
+            for (k = 0; k < scale; k++) *out++ = ((const u32 *)src)[i];
+        }
+    } else {
+        u16 * out = dst;
+        for (i = 0; i < count; i++) {
+            for (k = 0; k < scale; k++) *out++ = ((const u16 *)src)[i];
+        }
+    }
+}
+
+static void Vega_DarkenLineScalar(void * dst, const void * src, u32 count, u8 size) {
+    u32 i;
+    if (size == 4) {
+        for (i = 0; i < count; i++) ((u32 *)dst)[i] = ((((const u32 *)src)[i] >> 1) & 0x7F7F7F7F) | (((const u32 *)src)[i] & 0xFF000000u);
+    } else {
+        for (i = 0; i < count; i++) ((u16 *)dst)[i] = (u16)((((const u16 *)src)[i] >> 1) & 0x7BEF);
+    }
+}
+
+static void Vega_MixChannelScalar(s32 * accL, s32 * accR, const s16 * src, s16 gainL, s16 gainR, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        accL[i] += (src[i] * gainL) >> 15;
+        accR[i] += (src[i] * gainR) >> 15;
+    }
+}
+
+static inline s16 Vega_Saturate16(s32 v) {
+    return (s16)((v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v);
+}
+
+static void Vega_NarrowMixScalar(s16 * dst, const s32 * acc, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        dst[i] = Vega_Saturate16(acc[i]);
+    }
+}
+
+static s32 Vega_FirDotScalar(const s16 * a, const s16 * b, u32 count) {
+    s32 sum = 0;
+    for (u32 i = 0; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#if VEGA_SIMD_X86
+static inline __m128i Vega_MergeMaskSSE2(__m128i color, __m128i prio, __m128i dstPrio) { // 16-bit lanes set where COLOR is enabled and PRIO >= DSTPRIO.
+    __m128i enabled = _mm_cmpeq_epi16(_mm_and_si128(color, _mm_set1_epi16(1)), _mm_set1_epi16(1));
+    __m128i above = _mm_cmpeq_epi8(_mm_max_epu8(prio, dstPrio), prio);
+    return _mm_and_si128(enabled, _mm_unpacklo_epi8(above, above));
+}
+
+static inline void Vega_MergeStepSSE2(VegaVideoColor * dst, u8 * dstPrio, __m128i color, __m128i prio) {
+    __m128i dp = _mm_loadl_epi64((const __m128i *)dstPrio);
+    __m128i mask = Vega_MergeMaskSSE2(color, prio, dp);
+    __m128i d = _mm_loadu_si128((const __m128i *)dst);
+    _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_and_si128(mask, color), _mm_andnot_si128(mask, d)));
+    mask = _mm_packs_epi16(mask, mask);
+    _mm_storel_epi64((__m128i *)dstPrio, _mm_or_si128(_mm_and_si128(mask, prio), _mm_andnot_si128(mask, dp)));
+}
+
+static void Vega_MergeLineSSE2(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, const u8 * srcPrio, u32 count) {
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        Vega_MergeStepSSE2(&dst[i], &dstPrio[i], _mm_loadu_si128((const __m128i *)&src[i]), _mm_loadl_epi64((const __m128i *)&srcPrio[i]));
+    }
+    Vega_MergeLineScalar(&dst[i], &dstPrio[i], &src[i], &srcPrio[i], count - i);
+}
+
+static void Vega_MergeSpanSSE2(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, u8 prio, u32 count) {
+    u32 i = 0;
+    __m128i p = _mm_set1_epi8((char)prio);
+    for (; i + 8 <= count; i += 8) {
+        Vega_MergeStepSSE2(&dst[i], &dstPrio[i], _mm_loadu_si128((const __m128i *)&src[i]), p);
+    }
+    Vega_MergeSpanScalar(&dst[i], &dstPrio[i], &src[i], prio, count - i);
+}
+
+static void Vega_ResolveLineSSE2(VegaVideoColor * dst, const VegaVideoColor * src, VegaVideoColor clear, u32 count) {
+    u32 i = 0;
+    __m128i c = _mm_set1_epi16((short)clear), one = _mm_set1_epi16(1), s, mask;
+    for (; i + 8 <= count; i += 8) {
+        s = _mm_loadu_si128((const __m128i *)&src[i]);
+        mask = _mm_cmpeq_epi16(_mm_and_si128(s, one), one);
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_or_si128(_mm_and_si128(mask, s), _mm_andnot_si128(mask, c)));
+    }
+    Vega_ResolveLineScalar(&dst[i], &src[i], clear, count - i);
+}
+
+static inline __m128i Vega_Widen5SSE2(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 3), _mm_srli_epi16(v, 2));
+}
+
+static void Vega_ConvertLineSSE2(void * dst, const VegaVideoColor * src, u32 count, VegaVideoFormat format) {
+    u32 i = 0;
+    u8 size = (format == VEGA_VIDFMT_RGB565) ? 2 : 4;
+    __m128i mask5 = _mm_set1_epi16(0x1F), alpha = _mm_set1_epi16((short)0xFF00), c, r, g, b, lo, hi;
+    for (; i + 8 <= count; i += 8) {
+        c = _mm_loadu_si128((const __m128i *)&src[i]);
+        r = _mm_srli_epi16(c, 11);
+        g = _mm_and_si128(_mm_srli_epi16(c, 6), mask5);
+        b = _mm_and_si128(_mm_srli_epi16(c, 1), mask5);
+        if (format == VEGA_VIDFMT_RGB565) {
+            g = _mm_or_si128(_mm_slli_epi16(g, 1), _mm_srli_epi16(g, 4));
+            _mm_storeu_si128((__m128i *)((u16 *)dst + i), _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b));
+            continue;
+        }
+        if (format == VEGA_VIDFMT_BGRA8888) {
+            lo = r;
+            r = b;
+            b = lo;
+        }
+        lo = _mm_or_si128(Vega_Widen5SSE2(r), _mm_slli_epi16(Vega_Widen5SSE2(g), 8)); // Bytes 0 and 1 of each pixel.
+        hi = _mm_or_si128(Vega_Widen5SSE2(b), alpha); // Bytes 2 and 3.
+        _mm_storeu_si128((__m128i *)((u32 *)dst + i), _mm_unpacklo_epi16(lo, hi));
+        _mm_storeu_si128((__m128i *)((u32 *)dst + i + 4), _mm_unpackhi_epi16(lo, hi));
+    }
+    Vega_ConvertLineScalar((u8 *)dst + (i * size), &src[i], count - i, format);
+}
+
+static void Vega_ExpandLineSSE2(void * dst, const void * src, u32 count, u8 scale, u8 size) {
+    u32 i = 0;
+    __m128i v, a, b;
+    __m128i * out = dst;
+    if (size == 4) {
+        for (; i + 4 <= count; i += 4) {
+            v = _mm_loadu_si128((const __m128i *)((const u32 *)src + i));
+            switch (scale) {
+                case 2:
+                    _mm_storeu_si128(out++, _mm_unpacklo_epi32(v, v));
+                    _mm_storeu_si128(out++, _mm_unpackhi_epi32(v, v));
+                    break;
+                case 3:
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+                    break;
+                default:
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 0, 0, 0)));
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1)));
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 2, 2)));
+                    _mm_storeu_si128(out++, _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)));
+                    break;
+            }
+        }
+    } else if (scale != 3) { // Spreading 16-bit pixels by 3 needs a byte shuffle, which SSE2 lacks.
+        for (; i + 8 <= count; i += 8) {
+            v = _mm_loadu_si128((const __m128i *)((const u16 *)src + i));
+            a = _mm_unpacklo_epi16(v, v);
+            b = _mm_unpackhi_epi16(v, v);
+            if (scale == 2) {
+                _mm_storeu_si128(out++, a);
+                _mm_storeu_si128(out++, b);
+            } else {
+                _mm_storeu_si128(out++, _mm_unpacklo_epi32(a, a));
+                _mm_storeu_si128(out++, _mm_unpackhi_epi32(a, a));
+                _mm_storeu_si128(out++, _mm_unpacklo_epi32(b, b));
+                _mm_storeu_si128(out++, _mm_unpackhi_epi32(b, b));
+            }
+        }
+    }
+    Vega_ExpandLineScalar(out, (const u8 *)src + (i * size), count - i, scale, size);
+}
+
+static void Vega_DarkenLineSSE2(void * dst, const void * src, u32 count, u8 size) {
+    u32 i = 0, bytes = count * size;
+    __m128i keep = (size == 4) ? _mm_set1_epi32(0x7F7F7F7F) : _mm_set1_epi16(0x7BEF);
+    __m128i alpha = (size == 4) ? _mm_set1_epi32((int)0xFF000000u) : _mm_setzero_si128(), v;
+    for (; i + 16 <= bytes; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)((const u8 *)src + i));
+        _mm_storeu_si128((__m128i *)((u8 *)dst + i), _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 1), keep), _mm_and_si128(v, alpha)));
+    }
+    Vega_DarkenLineScalar((u8 *)dst + i, (const u8 *)src + i, (bytes - i) / size, size);
+}
+
+static void Vega_MixChannelSSE2(s32 * accL, s32 * accR, const s16 * src, s16 gainL, s16 gainR, u32 count) {
+    u32 i = 0;
+    __m128i gl = _mm_set1_epi16(gainL), gr = _mm_set1_epi16(gainR), v, lo, hi;
+    for (; i + 8 <= count; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)&src[i]);
+        lo = _mm_mullo_epi16(v, gl); // The low and high halves of each 32-bit product, put back together by the unpacks.
+        hi = _mm_mulhi_epi16(v, gl);
+        _mm_storeu_si128((__m128i *)&accL[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&accL[i]), _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15)));
+        _mm_storeu_si128((__m128i *)&accL[i + 4], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&accL[i + 4]), _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15)));
+        lo = _mm_mullo_epi16(v, gr);
+        hi = _mm_mulhi_epi16(v, gr);
+        _mm_storeu_si128((__m128i *)&accR[i], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&accR[i]), _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 15)));
+        _mm_storeu_si128((__m128i *)&accR[i + 4], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&accR[i + 4]), _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 15)));
+    }
+    Vega_MixChannelScalar(&accL[i], &accR[i], &src[i], gainL, gainR, count - i);
+}
+
+static void Vega_NarrowMixSSE2(s16 * dst, const s32 * acc, u32 count) {
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_packs_epi32(_mm_loadu_si128((const __m128i *)&acc[i]), _mm_loadu_si128((const __m128i *)&acc[i + 4])));
+    }
+    Vega_NarrowMixScalar(&dst[i], &acc[i], count - i);
+}
+
+static s32 Vega_FirDotSSE2(const s16 * a, const s16 * b, u32 count) {
+    u32 i = 0;
+    __m128i sum = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)&a[i]), _mm_loadu_si128((const __m128i *)&b[i])));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum) + Vega_FirDotScalar(&a[i], &b[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static inline void Vega_MergeStepAVX2(VegaVideoColor * dst, u8 * dstPrio, __m256i color, __m128i prio) {
+    __m128i dp8 = _mm_loadu_si128((const __m128i *)dstPrio);
+    __m256i dp = _mm256_cvtepu8_epi16(dp8), p = _mm256_cvtepu8_epi16(prio), one = _mm256_set1_epi16(1);
+    __m256i mask = _mm256_and_si256(_mm256_cmpeq_epi16(_mm256_and_si256(color, one), one), _mm256_cmpeq_epi16(_mm256_max_epu16(p, dp), p));
+    __m256i d = _mm256_loadu_si256((const __m256i *)dst);
+    _mm256_storeu_si256((__m256i *)dst, _mm256_blendv_epi8(d, color, mask));
+    dp = _mm256_blendv_epi8(dp, p, mask);
+    dp = _mm256_permute4x64_epi64(_mm256_packus_epi16(dp, dp), 0xD8);
+    _mm_storeu_si128((__m128i *)dstPrio, _mm256_castsi256_si128(dp));
+}
+
+__attribute__((target("avx2")))
+static void Vega_MergeLineAVX2(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, const u8 * srcPrio, u32 count) {
+    u32 i = 0;
+    for (; i + 16 <= count; i += 16) {
+        Vega_MergeStepAVX2(&dst[i], &dstPrio[i], _mm256_loadu_si256((const __m256i *)&src[i]), _mm_loadu_si128((const __m128i *)&srcPrio[i]));
+    }
+    Vega_MergeLineSSE2(&dst[i], &dstPrio[i], &src[i], &srcPrio[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static void Vega_MergeSpanAVX2(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, u8 prio, u32 count) {
+    u32 i = 0;
+    __m128i p = _mm_set1_epi8((char)prio);
+    for (; i + 16 <= count; i += 16) {
+        Vega_MergeStepAVX2(&dst[i], &dstPrio[i], _mm256_loadu_si256((const __m256i *)&src[i]), p);
+    }
+    Vega_MergeSpanSSE2(&dst[i], &dstPrio[i], &src[i], prio, count - i);
+}
+
+__attribute__((target("avx2")))
+static void Vega_ResolveLineAVX2(VegaVideoColor * dst, const VegaVideoColor * src, VegaVideoColor clear, u32 count) {
+    u32 i = 0;
+    __m256i c = _mm256_set1_epi16((short)clear), one = _mm256_set1_epi16(1), s, mask;
+    for (; i + 16 <= count; i += 16) {
+        s = _mm256_loadu_si256((const __m256i *)&src[i]);
+        mask = _mm256_cmpeq_epi16(_mm256_and_si256(s, one), one);
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_blendv_epi8(c, s, mask));
+    }
+    Vega_ResolveLineSSE2(&dst[i], &src[i], clear, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Vega_Widen5AVX2(__m256i v) {
+    return _mm256_or_si256(_mm256_slli_epi16(v, 3), _mm256_srli_epi16(v, 2));
+}
+
+__attribute__((target("avx2")))
+static void Vega_ConvertLineAVX2(void * dst, const VegaVideoColor * src, u32 count, VegaVideoFormat format) {
+    u32 i = 0;
+    u8 size = (format == VEGA_VIDFMT_RGB565) ? 2 : 4;
+    __m256i mask5 = _mm256_set1_epi16(0x1F), alpha = _mm256_set1_epi16((short)0xFF00), c, r, g, b, lo, hi;
+    for (; i + 16 <= count; i += 16) {
+        c = _mm256_loadu_si256((const __m256i *)&src[i]);
+        r = _mm256_srli_epi16(c, 11);
+        g = _mm256_and_si256(_mm256_srli_epi16(c, 6), mask5);
+        b = _mm256_and_si256(_mm256_srli_epi16(c, 1), mask5);
+        if (format == VEGA_VIDFMT_RGB565) {
+            g = _mm256_or_si256(_mm256_slli_epi16(g, 1), _mm256_srli_epi16(g, 4));
+            _mm256_storeu_si256((__m256i *)((u16 *)dst + i), _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(r, 11), _mm256_slli_epi16(g, 5)), b));
+            continue;
+        }
+        if (format == VEGA_VIDFMT_BGRA8888) {
+            lo = r;
+            r = b;
+            b = lo;
+        }
+        lo = _mm256_or_si256(Vega_Widen5AVX2(r), _mm256_slli_epi16(Vega_Widen5AVX2(g), 8));
+        hi = _mm256_or_si256(Vega_Widen5AVX2(b), alpha);
+        c = _mm256_unpacklo_epi16(lo, hi); // Pixels 0-3 and 8-11, the unpacks work within each 128-bit half.
+        hi = _mm256_unpackhi_epi16(lo, hi); // Pixels 4-7 and 12-15.
+        _mm256_storeu_si256((__m256i *)((u32 *)dst + i), _mm256_permute2x128_si256(c, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)((u32 *)dst + i + 8), _mm256_permute2x128_si256(c, hi, 0x31));
+    }
+    Vega_ConvertLineSSE2((u8 *)dst + (i * size), &src[i], count - i, format);
+}
+
+__attribute__((target("avx2")))
+static void Vega_ExpandLineAVX2(void * dst, const void * src, u32 count, u8 scale, u8 size) {
+    u32 i = 0, index[VEGA_VIDOUT_MAXSCALE * 8];
+    u8 shuffle[VEGA_VIDOUT_MAXSCALE * 16], k;
+    __m256i v, order[VEGA_VIDOUT_MAXSCALE];
+    __m128i h, picks[VEGA_VIDOUT_MAXSCALE];
+    u8 * out = dst;
+    if (size == 4) {
+        for (k = 0; k < scale * 8; k++) index[k] = k / scale; // Output lane K of a group takes input pixel K / SCALE.
+        for (k = 0; k < scale; k++) order[k] = _mm256_loadu_si256((const __m256i *)&index[k * 8]);
+        for (; i + 8 <= count; i += 8) {
+            v = _mm256_loadu_si256((const __m256i *)((const u32 *)src + i));
+            for (k = 0; k < scale; k++, out += 32) _mm256_storeu_si256((__m256i *)out, _mm256_permutevar8x32_epi32(v, order[k]));
+        }
+    } else {
+        for (k = 0; k < scale * 16; k++) shuffle[k] = (u8)((((k >> 1) / scale) << 1) | (k & 1));
+        for (k = 0; k < scale; k++) picks[k] = _mm_loadu_si128((const __m128i *)&shuffle[k * 16]);
+        for (; i + 8 <= count; i += 8) {
+            h = _mm_loadu_si128((const __m128i *)((const u16 *)src + i));
+            for (k = 0; k < scale; k++, out += 16) _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(h, picks[k]));
+        }
+    }
+    Vega_ExpandLineScalar(out, (const u8 *)src + (i * size), count - i, scale, size);
+}
+
+__attribute__((target("avx2")))
+static void Vega_DarkenLineAVX2(void * dst, const void * src, u32 count, u8 size) {
+    u32 i = 0, bytes = count * size;
+    __m256i keep = (size == 4) ? _mm256_set1_epi32(0x7F7F7F7F) : _mm256_set1_epi16(0x7BEF);
+    __m256i alpha = (size == 4) ? _mm256_set1_epi32((int)0xFF000000u) : _mm256_setzero_si256(), v;
+    for (; i + 32 <= bytes; i += 32) {
+        v = _mm256_loadu_si256((const __m256i *)((const u8 *)src + i));
+        _mm256_storeu_si256((__m256i *)((u8 *)dst + i), _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 1), keep), _mm256_and_si256(v, alpha)));
+    }
+    Vega_DarkenLineSSE2((u8 *)dst + i, (const u8 *)src + i, (bytes - i) / size, size);
+}
+
+__attribute__((target("avx2")))
+static void Vega_MixChannelAVX2(s32 * accL, s32 * accR, const s16 * src, s16 gainL, s16 gainR, u32 count) {
+    u32 i = 0;
+    __m256i gl = _mm256_set1_epi32(gainL), gr = _mm256_set1_epi32(gainR), v;
+    for (; i + 8 <= count; i += 8) {
+        v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)&src[i]));
+        _mm256_storeu_si256((__m256i *)&accL[i], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&accL[i]), _mm256_srai_epi32(_mm256_mullo_epi32(v, gl), 15)));
+        _mm256_storeu_si256((__m256i *)&accR[i], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&accR[i]), _mm256_srai_epi32(_mm256_mullo_epi32(v, gr), 15)));
+    }
+    Vega_MixChannelScalar(&accL[i], &accR[i], &src[i], gainL, gainR, count - i);
+}
+
+__attribute__((target("avx2")))
+static void Vega_NarrowMixAVX2(s16 * dst, const s32 * acc, u32 count) {
+    u32 i = 0;
+    __m256i v;
+    for (; i + 16 <= count; i += 16) {
+        v = _mm256_packs_epi32(_mm256_loadu_si256((const __m256i *)&acc[i]), _mm256_loadu_si256((const __m256i *)&acc[i + 8]));
+        _mm256_storeu_si256((__m256i *)&dst[i], _mm256_permute4x64_epi64(v, 0xD8)); // The pack works within each 128-bit half.
+    }
+    Vega_NarrowMixSSE2(&dst[i], &acc[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static s32 Vega_FirDotAVX2(const s16 * a, const s16 * b, u32 count) {
+    u32 i = 0;
+    __m256i sum = _mm256_setzero_si256();
+    __m128i half;
+    for (; i + 16 <= count; i += 16) {
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)&a[i]), _mm256_loadu_si256((const __m256i *)&b[i])));
+    }
+    half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+#endif
+
+static void Vega_SimdSelect() {
+    const char * cap = getenv("VEGA_SIMD"); // Caps the kernel level, eg. VEGA_SIMD=scalar, for comparing against the fallbacks.
+    Vega_Simd = (VegaSimdKernels){
+        .level = VEGA_SIMD_SCALAR,
+        .mergeLine = Vega_MergeLineScalar,
+        .mergeSpan = Vega_MergeSpanScalar,
+        .resolveLine = Vega_ResolveLineScalar,
+        .convertLine = Vega_ConvertLineScalar,
+        .expandLine = Vega_ExpandLineScalar,
+        .darkenLine = Vega_DarkenLineScalar,
+        .mixChannel = Vega_MixChannelScalar,
+        .narrowMix = Vega_NarrowMixScalar,
+        .firDot = Vega_FirDotScalar,
+    };
+#if VEGA_SIMD_X86
+    if (cap && !strcmp(cap, "scalar")) return;
+    Vega_Simd = (VegaSimdKernels){
+        .level = VEGA_SIMD_SSE2,
+        .mergeLine = Vega_MergeLineSSE2,
+        .mergeSpan = Vega_MergeSpanSSE2,
+        .resolveLine = Vega_ResolveLineSSE2,
+        .convertLine = Vega_ConvertLineSSE2,
+        .expandLine = Vega_ExpandLineSSE2,
+        .darkenLine = Vega_DarkenLineSSE2,
+        .mixChannel = Vega_MixChannelSSE2,
+        .narrowMix = Vega_NarrowMixSSE2,
+        .firDot = Vega_FirDotSSE2,
+    };
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && !(cap && !strcmp(cap, "sse2"))) {
+        Vega_Simd = (VegaSimdKernels){
+            .level = VEGA_SIMD_AVX2,
+            .mergeLine = Vega_MergeLineAVX2,
+            .mergeSpan = Vega_MergeSpanAVX2,
+            .resolveLine = Vega_ResolveLineAVX2,
+            .convertLine = Vega_ConvertLineAVX2,
+            .expandLine = Vega_ExpandLineAVX2,
+            .darkenLine = Vega_DarkenLineAVX2,
+            .mixChannel = Vega_MixChannelAVX2,
+            .narrowMix = Vega_NarrowMixAVX2,
+            .firDot = Vega_FirDotAVX2,
+        };
+    }
+#endif
+}
+
+void Vega_SimdInit() { // Picked once per process, so contexts initializing on other threads never see the table half written.
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, Vega_SimdSelect);
+}
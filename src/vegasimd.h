@@ -0,0 +1,54 @@
+/*
+    Vega Engine SIMD kernel header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_SIMD_H
+#define VEGA_SIMD_H 1
+
+#include "../include/vegatypes.h"
+#include "../include/vegavideo.h"
+
+typedef enum VegaSimdLevel {
+    VEGA_SIMD_SCALAR,
+    VEGA_SIMD_SSE2,
+    VEGA_SIMD_AVX2,
+} VegaSimdLevel;
+
+typedef struct VegaSimdKernels { // Filled by Vega_SimdInit with the best versions the CPU supports.
+    VegaSimdLevel level;
+    void (*mergeLine)(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, const u8 * srcPrio, u32 count); // Copies each enabled SRC pixel whose priority is at least the one already in DST.
+    void (*mergeSpan)(VegaVideoColor * dst, u8 * dstPrio, const VegaVideoColor * src, u8 prio, u32 count); // Same as mergeLine with every SRC pixel at priority PRIO.
+    void (*resolveLine)(VegaVideoColor * dst, const VegaVideoColor * src, VegaVideoColor clear, u32 count); // Writes each enabled SRC pixel to DST, or CLEAR where SRC is disabled.
+    void (*convertLine)(void * dst, const VegaVideoColor * src, u32 count, VegaVideoFormat format); // Writes COUNT pixels to DST in FORMAT.
+    void (*expandLine)(void * dst, const void * src, u32 count, u8 scale, u8 size); // Repeats each of COUNT pixels of SIZE bytes SCALE times, SCALE up to VEGA_VIDOUT_MAXSCALE.
+    void (*darkenLine)(void * dst, const void * src, u32 count, u8 size); // Halves the color channels of COUNT converted pixels of SIZE bytes, keeping alpha.
+    void (*mixChannel)(s32 * accL, s32 * accR, const s16 * src, s16 gainL, s16 gainR, u32 count); // Adds SRC scaled by the Q15 gains, each product shifted back down by 15, to both accumulators.
+    void (*narrowMix)(s16 * dst, const s32 * acc, u32 count); // Saturates the accumulated samples to 16 bits.
+    s32 (*firDot)(const s16 * a, const s16 * b, u32 count); // Returns the dot product of A and B. COUNT is a multiple of 16.
+} VegaSimdKernels;
+
+extern VegaSimdKernels Vega_Simd;
+
+void Vega_SimdInit();
+
+#endif
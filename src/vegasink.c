@@ -0,0 +1,220 @@
+/*
+    Vega Engine frame sink sources.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "vegasink.h"
+
+struct VegaSink {
+    VegaVideoOutput output;
+    u16 w, h; // Size of the frames pushed, before scaling.
+    u32 pitch; // Bytes in one converted row.
+    u32 frameSize; // Bytes in one converted frame, rows packed without padding.
+    u32 slotCount;
+    int fd; // Descriptor written by the writer thread, or -1 for shared memory sinks.
+    u8 * slots; // slotCount frames waiting for the writer thread.
+    u32 queued; // Frames handed to the writer thread. Only changed by the video thread.
+    u32 sent; // Frames the writer thread finished. Only changed by the writer thread.
+    bool8 quit;
+    bool8 failed; // Set once a write fails, every later frame is dropped.
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    VegaVideoSinkHeader * shm;
+    u64 shmSize;
+    char * shmName;
+};
+
+static void * Vega_SinkWriter(void * arg) {
+    VegaSink * sink = arg;
+    sigset_t pipeSignal;
+    const u8 * p;
+    u32 left;
+    ssize_t done;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSignal, NULL); // A reader that went away fails the write with EPIPE instead of ending the process.
+    pthread_mutex_lock(&sink->lock);
+    while (1) {
+        while (!sink->quit && sink->sent == sink->queued) pthread_cond_wait(&sink->wake, &sink->lock);
+        if (sink->sent == sink->queued) break; // Quitting, and every queued frame is written.
+        pthread_mutex_unlock(&sink->lock);
+        p = &sink->slots[(sink->sent % sink->slotCount) * sink->frameSize];
+        left = sink->frameSize;
+        while (left) {
+            done = write(sink->fd, p, left);
+            if (done < 0 && errno == EINTR) continue;
+            if (done <= 0) break;
+            p += done;
+            left -= (u32)done;
+        }
+        pthread_mutex_lock(&sink->lock);
+        if (left) {
+            perror("video sink write");
+            sink->failed = true;
+            break;
+        }
+        sink->sent++;
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return NULL;
+}
+
+static VegaSink * Vega_SinkAlloc(u32 slots, VegaVideoOutput output, u16 w, u16 h) {
+    VegaSink * sink = calloc(1, sizeof(VegaSink));
+    if (!sink) {
+        perror("video sink allocation");
+        return NULL;
+    }
+    sink->output = output;
+    sink->w = w;
+    sink->h = h;
+    sink->pitch = Vega_VideoGetOutputPitch(output, w);
+    sink->frameSize = sink->pitch * h * output.scale;
+    sink->slotCount = slots ? slots : 1;
+    sink->fd = -1;
+    return sink;
+}
+
+VegaSink * Vega_SinkOpenFD(int fd, u32 slots, VegaVideoOutput output, u16 w, u16 h) {
+    VegaSink * sink = Vega_SinkAlloc(slots, output, w, h);
+    if (!sink) return NULL;
+    sink->fd = fd;
+    sink->slots = malloc((size_t)sink->slotCount * sink->frameSize);
+    if (!sink->slots) {
+        perror("video sink allocation");
+        free(sink);
+        return NULL;
+    }
+    pthread_mutex_init(&sink->lock, NULL);
+    pthread_cond_init(&sink->wake, NULL);
+    if (pthread_create(&sink->thread, NULL, Vega_SinkWriter, sink)) {
+        perror("video sink thread creation");
+        pthread_mutex_destroy(&sink->lock);
+        pthread_cond_destroy(&sink->wake);
+        free(sink->slots);
+        free(sink);
+        return NULL;
+    }
+    return sink;
+}
+
+VegaSink * Vega_SinkOpenShm(const char * name, u32 slots, VegaVideoOutput output, u16 w, u16 h) {
+    VegaSink * sink = Vega_SinkAlloc(slots, output, w, h);
+    VegaVideoSinkHeader * header;
+    u32 slotSize;
+    int fd;
+    if (!sink) return NULL;
+    slotSize = (VEGA_VIDSINK_SLOTHEADER + sink->frameSize + 4095) & ~4095u;
+    sink->shmSize = 4096 + ((u64)slotSize * sink->slotCount);
+    sink->shmName = strdup(name);
+    if (!sink->shmName) {
+        perror("video sink allocation");
+        free(sink);
+        return NULL;
+    }
+    fd = shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, (off_t)sink->shmSize)) {
+        perror("video sink shared memory");
+        if (fd >= 0) {
+            close(fd);
+            shm_unlink(name);
+        }
+        free(sink->shmName);
+        free(sink);
+        return NULL;
+    }
+    header = mmap(NULL, sink->shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        perror("video sink shared memory mapping");
+        shm_unlink(name);
+        free(sink->shmName);
+        free(sink);
+        return NULL;
+    }
+    header->slotCount = sink->slotCount;
+    header->slotSize = slotSize;
+    header->pitch = sink->pitch;
+    header->w = (u16)(sink->pitch / ((output.format == VEGA_VIDFMT_RGB565) ? 2 : 4));
+    header->h = (u16)(sink->frameSize / sink->pitch);
+    header->format = output.format;
+    header->dataOffset = 4096;
+    __atomic_store_n(&header->magic, VEGA_VIDSINK_MAGIC, __ATOMIC_RELEASE); // Consumers may map the object before the header is filled in.
+    sink->shm = header;
+    return sink;
+}
+
+bool8 Vega_SinkPush(VegaSink * sink, const VegaVideoColor * pixels, u32 pitch, u64 frame) {
+    VegaVideoSinkHeader * header = sink->shm;
+    u64 seq;
+    u8 * slot;
+    bool8 full;
+    if (header) {
+        seq = header->writeSeq;
+        if (seq - __atomic_load_n(&header->readSeq, __ATOMIC_ACQUIRE) >= header->slotCount) return false;
+        slot = (u8 *)header + header->dataOffset + ((seq % header->slotCount) * header->slotSize);
+        memcpy(slot, &frame, sizeof(frame));
+        Vega_VideoConvertFrame(sink->output, slot + VEGA_VIDSINK_SLOTHEADER, header->pitch, pixels, pitch, sink->w, sink->h);
+        __atomic_store_n(&header->writeSeq, seq + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+    pthread_mutex_lock(&sink->lock);
+    full = sink->failed || (sink->queued - sink->sent >= sink->slotCount);
+    pthread_mutex_unlock(&sink->lock);
+    if (full) return false;
+    Vega_VideoConvertFrame(sink->output, &sink->slots[(sink->queued % sink->slotCount) * sink->frameSize], sink->pitch, pixels, pitch, sink->w, sink->h);
+    pthread_mutex_lock(&sink->lock);
+    sink->queued++;
+    pthread_cond_signal(&sink->wake);
+    pthread_mutex_unlock(&sink->lock);
+    return true;
+}
+
+void Vega_SinkClose(VegaSink * sink) { // Waits for the writer thread to write the frames still queued, unless a write already failed.
+    if (!sink) return;
+    if (sink->shm) {
+        munmap(sink->shm, sink->shmSize);
+        shm_unlink(sink->shmName);
+        free(sink->shmName);
+    } else {
+        pthread_mutex_lock(&sink->lock);
+        sink->quit = true;
+        pthread_cond_signal(&sink->wake);
+        pthread_mutex_unlock(&sink->lock);
+        pthread_join(sink->thread, NULL);
+        pthread_mutex_destroy(&sink->lock);
+        pthread_cond_destroy(&sink->wake);
+        free(sink->slots);
+    }
+    free(sink);
+}
@@ -0,0 +1,38 @@
+/*
+    Vega Engine frame sink header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_SINK_H
+#define VEGA_SINK_H 1
+
+#include "../include/vegatypes.h"
+#include "../include/vegavideo.h"
+
+typedef struct VegaSink VegaSink;
+
+VegaSink * Vega_SinkOpenFD(int fd, u32 slots, VegaVideoOutput output, u16 w, u16 h); // OUTPUT must have a scale in range. Returns NULL on failure.
+VegaSink * Vega_SinkOpenShm(const char * name, u32 slots, VegaVideoOutput output, u16 w, u16 h);
+bool8 Vega_SinkPush(VegaSink * sink, const VegaVideoColor * pixels, u32 pitch, u64 frame); // Returns false if the frame was dropped. Never waits on the consumer.
+void Vega_SinkClose(VegaSink * sink);
+
+#endif
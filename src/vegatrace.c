@@ -0,0 +1,178 @@
+/*
+    Vega Engine trace sources.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../include/vegavideo.h"
+#include "vegatrace.h"
+
+typedef struct VegaTraceEvent {
+    u64 time;
+    u32 arg;
+    u8 name;
+    char phase; // 'B' or 'E', as in the trace event format.
+} VegaTraceEvent;
+
+typedef struct VegaTraceRing { // The newest events of one thread. Only the owning thread writes to it.
+    struct VegaTraceRing * next;
+    VegaTraceEvent * events;
+    u32 head; // Events recorded so far.
+    u32 track; // Thread ID in the dump.
+    char threadName[24];
+} VegaTraceRing;
+
+static const char * const traceNames[VEGA_TRACE_COUNT] = {"frame", "render", "line", "band", "flush", "frameStartCB", "frameEndCB", "lineStartCB", "lineEndCB",
+    "hBlankCB", "vBlankCB", "runUntilCB", "event", "memDirtyCB", "sprite walk", "tile decode", "palette refresh", "plane cache", "frame output", "present", "sleep",
+    "upload", "audio mix"};
+static const char * const traceArgNames[VEGA_TRACE_COUNT] = {[VEGA_TRACE_FRAME]="frame", [VEGA_TRACE_LINE]="line", [VEGA_TRACE_BAND]="line",
+    [VEGA_TRACE_LINESTART]="line", [VEGA_TRACE_LINEEND]="line", [VEGA_TRACE_HBLANK]="line"};
+
+bool8 Vega_TraceOn = false;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER; // Guards the ring list, never taken while recording.
+static VegaTraceRing * traceRings;
+static u32 traceRingSize; // Events per ring, a power of two.
+static u32 traceGeneration; // Bumped whenever the rings are thrown away, so threads know to make a new one.
+static u32 traceTracks;
+static u64 traceStart;
+static __thread VegaTraceRing * traceRing;
+static __thread u32 traceRingGeneration;
+static __thread char traceThreadName[24] = "thread";
+
+static u64 Vega_TraceNow() {
+    struct timespec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((u64)spec.tv_sec * 1000000000) + (u64)spec.tv_nsec;
+}
+
+static void Vega_TraceAttach() { // Gives the calling thread a ring of its own.
+    VegaTraceRing * ring = malloc(sizeof(VegaTraceRing));
+    traceRingGeneration = __atomic_load_n(&traceGeneration, __ATOMIC_RELAXED);
+    traceRing = NULL;
+    if (!ring || !(ring->events = malloc(sizeof(VegaTraceEvent) * traceRingSize))) {
+        perror("trace ring allocation");
+        free(ring);
+        return;
+    }
+    ring->head = 0;
+    strcpy(ring->threadName, traceThreadName);
+    pthread_mutex_lock(&traceLock);
+    ring->track = ++traceTracks;
+    ring->next = traceRings;
+    traceRings = ring;
+    pthread_mutex_unlock(&traceLock);
+    traceRing = ring;
+}
+
+void Vega_TraceRecord(VegaTraceName name, char phase, u32 arg) {
+    VegaTraceRing * ring;
+    VegaTraceEvent * event;
+    if (traceRingGeneration != __atomic_load_n(&traceGeneration, __ATOMIC_RELAXED)) Vega_TraceAttach();
+    ring = traceRing;
+    if (!ring) return;
+    event = &ring->events[ring->head & (traceRingSize - 1)];
+    event->time = Vega_TraceNow();
+    event->arg = arg;
+    event->name = (u8)name;
+    event->phase = phase;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void Vega_TraceNameThread(const char * name, s32 index) {
+    if (index < 0) snprintf(traceThreadName, sizeof(traceThreadName), "%s", name);
+    else snprintf(traceThreadName, sizeof(traceThreadName), "%s %d", name, index);
+    if (traceRing && traceRingGeneration == __atomic_load_n(&traceGeneration, __ATOMIC_RELAXED)) strcpy(traceRing->threadName, traceThreadName);
+}
+
+static void Vega_TraceFreeRings() {
+    VegaTraceRing * next;
+    while (traceRings) {
+        next = traceRings->next;
+        free(traceRings->events);
+        free(traceRings);
+        traceRings = next;
+    }
+    traceTracks = 0;
+}
+
+void Vega_VideoSetTrace(u32 events) {
+#if VEGA_TRACE
+    u32 size = 1;
+    pthread_mutex_lock(&traceLock);
+    Vega_TraceOn = false;
+    Vega_TraceFreeRings();
+    __atomic_store_n(&traceGeneration, traceGeneration + 1, __ATOMIC_RELAXED);
+    if (events) {
+        while (size < events) size <<= 1;
+        traceRingSize = size;
+        traceStart = Vega_TraceNow();
+        Vega_TraceOn = true;
+    }
+    pthread_mutex_unlock(&traceLock);
+#else
+    (void)events;
+#endif
+}
+
+bool8 Vega_VideoDumpTrace(const char * path) {
+#if VEGA_TRACE
+    const VegaTraceRing * ring;
+    const VegaTraceEvent * event;
+    u32 head, i;
+    int pid = (int)getpid();
+    bool8 ok;
+    FILE * out = fopen(path, "w");
+    if (!out) {
+        perror("trace dump");
+        return false;
+    }
+    pthread_mutex_lock(&traceLock);
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Vega Engine\"}}", pid);
+    for (ring = traceRings; ring; ring = ring->next) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", pid, ring->track, ring->threadName);
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (i = (head > traceRingSize) ? head - traceRingSize : 0; i != head; i++) { // Oldest first. A wrapped ring can start on an unmatched end, which viewers skip.
+            event = &ring->events[i & (traceRingSize - 1)];
+            fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u", traceNames[event->name], event->phase, (double)(event->time - traceStart) / 1000, pid, ring->track);
+            if (event->phase == 'B' && traceArgNames[event->name]) fprintf(out, ",\"args\":{\"%s\":%u}", traceArgNames[event->name], event->arg);
+            fputc('}', out);
+        }
+    }
+    pthread_mutex_unlock(&traceLock);
+    fputs("\n]}\n", out);
+    ok = !ferror(out);
+    if (fclose(out) || !ok) {
+        perror("trace dump");
+        return false;
+    }
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
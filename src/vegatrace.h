@@ -0,0 +1,78 @@
+/*
+    Vega Engine trace header.
+
+    Copyright (c) 2023 SpacePython_
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#ifndef VEGA_TRACE_H
+#define VEGA_TRACE_H 1
+
+#include "../include/vegatypes.h"
+
+#ifndef VEGA_TRACE
+#define VEGA_TRACE 1 // Build with -DVEGA_TRACE=0 to leave the trace points out entirely.
+#endif
+
+typedef enum VegaTraceName { // Names of the spans recorded, see traceNames.
+    VEGA_TRACE_FRAME, // Arg: frame number.
+    VEGA_TRACE_RENDER,
+    VEGA_TRACE_LINE, // Arg: line.
+    VEGA_TRACE_BAND, // Arg: first line.
+    VEGA_TRACE_FLUSH,
+    VEGA_TRACE_FRAMESTART,
+    VEGA_TRACE_FRAMEEND,
+    VEGA_TRACE_LINESTART, // Arg: line.
+    VEGA_TRACE_LINEEND, // Arg: line.
+    VEGA_TRACE_HBLANK, // Arg: line.
+    VEGA_TRACE_VBLANK,
+    VEGA_TRACE_RUNUNTIL,
+    VEGA_TRACE_EVENT,
+    VEGA_TRACE_MEMDIRTY,
+    VEGA_TRACE_SPRITES,
+    VEGA_TRACE_TILES,
+    VEGA_TRACE_PALETTES,
+    VEGA_TRACE_PLANES,
+    VEGA_TRACE_OUTPUT,
+    VEGA_TRACE_PRESENT,
+    VEGA_TRACE_SLEEP,
+    VEGA_TRACE_UPLOAD,
+    VEGA_TRACE_AUDIO,
+    VEGA_TRACE_COUNT,
+} VegaTraceName;
+
+extern bool8 Vega_TraceOn; // Only changed while no traced thread is running.
+
+void Vega_TraceRecord(VegaTraceName name, char phase, u32 arg);
+void Vega_TraceNameThread(const char * name, s32 index); // Names the calling thread's track, followed by INDEX unless it is negative.
+
+static inline void Vega_TraceBegin(VegaTraceName name, u32 arg) {
+#if VEGA_TRACE
+    if (__builtin_expect(Vega_TraceOn, false)) Vega_TraceRecord(name, 'B', arg);
+#endif
+}
+
+static inline void Vega_TraceEnd(VegaTraceName name) {
+#if VEGA_TRACE
+    if (__builtin_expect(Vega_TraceOn, false)) Vega_TraceRecord(name, 'E', 0);
+#endif
+}
+
+#endif
@@ -25,16 +25,24 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
+#define VEGA_INTERNAL 1
 #include "../include/vega.h"
+#include "vegasimd.h"
+#include "vegasink.h"
+#include "vegasched.h"
+#include "vegatrace.h"
+#include "vegabackend.h"
 
 #if RENDER_SDL
 #include <SDL2/SDL.h>
-
-static SDL_Window * win = NULL;
-static SDL_Renderer * rend = NULL;
-static SDL_Texture * fBuf = NULL;
 #elif RENDER_GLFW
 #define GL_GLEXT_PROTOTYPES 1
 #include <GLES3/gl3.h>
@@ -45,9 +53,6 @@ extern const char * VegaVertShader;
 extern const size_t VegaFragShaderSize;
 extern const size_t VegaVertShaderSize;
 
-static GLFWwindow * win = NULL;
-static GLuint fragShader, vertShader, shaderProgram, paletteTexture, tileTexture, VBO;
-
 typedef struct VertAttrib {
     struct {
         uint x;
@@ -64,156 +69,1086 @@ typedef struct VertAttrib {
 #error "No rendering API was specified. Define a renderer macro."
 #endif
 
-typedef long double VegaTime;
+typedef u64 VegaTime; // Nanoseconds on CLOCK_MONOTONIC.
+
+typedef struct SpriteAttrib {
+    u16 id;
+    u16 x;
+    u16 y;
+    u16 w;
+    u16 h;
+    u8 palette;
+    u8 priority;
+} SpriteAttrib;
+
+typedef struct LineState { // Per-line raster state, captured on the calling thread right after lineStartCB.
+    const VegaVideoColor * palette;
+    VegaVideoColor clearColor;
+    bool8 blank;
+    bool8 reuse; // Set in incremental mode when the last frame's pixels are still right, so the line is not drawn.
+    u8 visibleCount;
+    VegaVideoSpan visible[VEGA_VIDSPAN_MAX + 1]; // The columns getBlankSpans left, the only ones anything is drawn in.
+} LineState;
+
+typedef struct PlaneLineState {
+    u32 hscroll;
+    u16 hmod;
+    u16 vmod;
+    bool8 enabled;
+    u8 windowCount;
+    VegaVideoSpan window[VEGA_VIDSPAN_MAX]; // Where the plane is shown, the whole line without getPlaneWindow.
+} PlaneLineState;
+
+typedef struct LineWork { // Scratch space for drawing a line. Each render thread owns one.
+    VegaVideoColor * lineColors; // The topmost enabled color of each pixel so far.
+    u8 * linePriorities; // The priority LINECOLORS was drawn at.
+    VegaVideoColor * layerColors; // One plane line or sprite span, before it is merged into LINECOLORS.
+    u8 * layerPriorities;
+    u8 * planeColors; // Filled by getPlaneLine, screenW entries per buffer.
+    u8 * planePalettes;
+    u8 * planePriorities;
+    u8 tileScratch[8]; // Row decoded on the fly for tiles outside the cache.
+    u8 * tileUse; // Tile cache bitmap of the line being drawn in incremental mode, or NULL.
+    VegaVideoState * state; // The state a render thread draws for.
+    u32 calls[VEGA_VIDCB_COUNT]; // Backend callbacks made by this thread since the last frame's statistics were collected.
+    u32 lineTimes[VEGA_VIDSTATS_LINEBUCKETS];
+    VegaTime lineTimeMax;
+} LineWork;
 
-static VegaVideoBackend videoBackend;
-static void ** memLocs = NULL;
-static VegaTime startTime = 0.0;
-static VegaVideoColor * linebufs;
+typedef struct StateHeader { // Start of every snapshot, followed by the size and contents of each memory area, then the backend state.
+    u32 magic;
+    u32 size;
+    u64 rasterFrame;
+    u32 memLocCount;
+    u32 stateSize; // Bytes written by the backend's saveStateCB.
+} StateHeader;
 
-#define linebufget(col, prio) linebufs[(col + (prio * videoBackend.screenW))]
+#define VEGA_STATE_MAGIC 0x31534756 // "VGS1"
+
+#define VEGA_ARENA_LINE 64
+#define VEGA_ARENA_PAGE 4096
+#define VEGA_ARENA_HUGEPAGE (2 << 20)
+
+typedef struct LineBand {
+    u32 start;
+    u32 end;
+} LineBand;
+
+struct VegaVideoState { // Everything one context's video subsystem keeps between calls.
+    VegaContext * owner; // Made current on the threads started for this state, NULL for the default context.
+#if RENDER_SDL
+    SDL_Window * win;
+    SDL_Renderer * rend;
+    SDL_Texture * fBuf;
+#elif RENDER_GLFW
+    GLFWwindow * win;
+    GLuint fragShader, vertShader, shaderProgram, paletteTexture, tileTexture, VBO;
+#endif
+    VegaVideoBackend videoBackend;
+    VegaVideoMode videoMode;
+    VegaVideoArenaType arenaType;
+    char * arenaPath;
+    u8 * arena; // Every buffer whose size is fixed at init, carved out by Vega_VideoLayoutArena.
+    u64 arenaSize;
+    u64 arenaMapSize; // Length to unmap, or 0 if the arena came from the heap.
+    u64 arenaAreasEnd; // The memory areas sit below this offset, everything above it is cleared at init.
+    void ** memLocs;
+    u32 * memLocSizes;
+    bool8 * memLocOwned; // Cleared for areas mapped to a caller-owned buffer.
+    u64 ** memLocDirty; // One bit per VEGA_VIDMEM_DIRTYBLOCK bytes of each area.
+    void ** memLocHome; // The arena space of each area, used whenever it is not mapped to a caller-owned buffer.
+    u64 ** memLocHomeDirty;
+    bool8 memLocStale; // Set when any bit in memLocDirty is set.
+    VegaTime frameInterval; // Time between frame deadlines, or 0 to run uncapped.
+    VegaTime frameDeadline; // When the frame being drawn should be presented.
+    VegaVideoStats videoStats;
+    u64 rasterFrame; // Frames drawn since init, for stamping the raster position.
+    u64 rasterNow; // Raster time the backend has been run to.
+    VegaScheduler scheduler;
+    u64 * rewindLatest; // Snapshot of the newest frame in the rewind history.
+    u64 * rewindNext; // Snapshot being captured, swapped with rewindLatest afterwards.
+    u8 * rewindDelta; // Scratch space for one encoded delta.
+    u8 * rewindRing; // Encoded deltas, each one turning a frame's snapshot into the one before it.
+    u32 * rewindOffsets; // Ring of rewindMaxFrames entries, indexed by the counters below modulo rewindMaxFrames.
+    u32 * rewindSizes;
+    u32 rewindMaxFrames;
+    u32 rewindBytes;
+    u32 rewindStateSize;
+    u32 rewindFirst; // Oldest delta kept.
+    u32 rewindCount;
+    u32 rewindWrite; // Where the next delta goes in rewindRing.
+    bool8 rewindPrimed; // Set once rewindLatest holds a snapshot.
+    VegaVideoColor * frameBuf; // Frames are drawn here in headless and incremental mode, otherwise the SDL path renders straight into the locked texture.
+    volatile bool8 running;
+    VegaVideoFrameCB frameCB;
+    VegaSink * sink;
+    VegaVideoOutput sinkOutput;
+    u16 * hScrollTables; // One table of screenH rows per plane, filled by getPlaneHScrollTable.
+    u16 * vScrollTables; // One table of screenW columns per plane, filled by getPlaneVScrollTable.
+    bool8 * planeCacheDirty;
+    u8 * tileCache; // tileCount decoded tiles, each 8 rows of 8 color indices.
+    u8 * tileCacheDirty; // One bit per tile in tileCache. Only used on the thread running the video loop, render threads just read tileCache.
+    bool8 tileCacheStale; // Set when any bit in tileCacheDirty is set.
+    VegaVideoColor * paletteCache; // Palette versions of (1 << paletteIndexDepth) lines of (1 << colorIndexDepth) resolved colors. One version per visible line plus one when rendering on threads.
+    VegaVideoColor * paletteCurrent; // The version lines captured from now on will use.
+    VegaVideoColor * paletteCacheHome; // Room for one version in the arena. The pool used with render threads is on the heap.
+    bool8 * paletteCacheDirty;
+    bool8 paletteCacheStale; // Set when any palette line or the clear color has to be fetched again.
+    bool8 clearColorDirty;
+    VegaVideoColor clearColor;
+    SpriteAttrib * spriteAttribs; // Snapshot of every enabled sprite, in the order they are drawn.
+    u16 spriteAttribCount;
+    bool8 * spriteAttribDirty; // Set for entries of spriteAttribs that have to be fetched again.
+    u16 * spriteSlots; // Index into spriteAttribs for each sprite ID, or UINT16_MAX if the sprite is not drawn.
+    u32 * spriteBucketStart; // screenH+1 offsets into spriteBuckets, one range per line.
+    u32 * spriteBucketFill; // Per-line counts, then fill cursors, while the buckets are rebuilt.
+    u16 * spriteBuckets; // Indices into spriteAttribs of the sprites overlapping each line, in draw order.
+    u32 spriteBucketCap;
+    bool8 spriteCacheStale; // Set when the sprite chain has to be walked again.
+    bool8 spriteBucketsStale; // Set when a sprite's attributes changed and the line buckets have to be rebuilt.
+    bool8 incremental;
+    u64 * lineHashes; // What each visible line was last drawn from, hashed by Vega_VideoCheckLine.
+    bool8 * lineForced; // Lines to draw again whatever their hash, for changes that don't show in the captured state.
+    u8 * lineTileUse; // One tile cache bitmap per visible line, the tiles it read when it was last drawn.
+    u8 * tileChanged; // Tiles updated since lineTileUse was last checked.
+    bool8 tileChangedStale;
+    u64 paletteSerial; // Bumped whenever a cached palette color actually changes.
+    u64 * vScrollHashes; // Hash of each plane's table in vScrollTables.
+    u32 linesDrawn;
+    LineState * lineJournal; // One entry per visible line.
+    PlaneLineState * planeJournal; // planeCount entries per visible line.
+    bool8 journalPending; // Set while captured lines are waiting on the render threads.
+    LineWork mainWork; // Used when lines are drawn on the calling thread.
+    LineWork * renderWork;
+    pthread_t * renderThreads;
+    u8 renderThreadCount;
+    u16 renderBandLines;
+    pthread_mutex_t renderLock;
+    pthread_cond_t renderWake;
+    pthread_cond_t renderDone;
+    bool8 renderQuit;
+    u8 * renderBuffers; // The line buffers of every render thread, Vega_VideoLineWorkSize bytes each.
+    LineBand * bandQueue; // Ring of screenH bands, indexed by the counters below modulo screenH.
+    u32 bandQueued;
+    u32 bandTaken;
+    u32 bandDone;
+    u32 bandStart; // First captured line not yet handed to the render threads.
+    u32 bandEnd; // One past the last captured line.
+    VegaVideoColor * renderPixels;
+    u32 renderPitch;
+    bool8 presentThreaded; // Set to upload and present from a thread of its own in window mode.
+    VegaVideoColor * presentBufs; // Three frames: the one being drawn, the newest finished one and the one on screen, indexed below.
+    u8 presentDrawn;
+    u8 presentReady;
+    u8 presentShown;
+    bool8 presentFresh; // Set while presentReady holds a frame the presentation thread has not taken yet.
+    bool8 presentQuit;
+    pthread_t presentThread;
+    pthread_mutex_t presentLock;
+    pthread_cond_t presentWake;
+};
+
+#define VEGA_VIDEO_STATE_INIT {.tileCacheStale=true, .paletteCacheStale=true, .clearColorDirty=true, .spriteCacheStale=true, .spriteBucketsStale=true, .renderBandLines=16, .renderLock=PTHREAD_MUTEX_INITIALIZER, .renderWake=PTHREAD_COND_INITIALIZER, .renderDone=PTHREAD_COND_INITIALIZER, .presentLock=PTHREAD_MUTEX_INITIALIZER, .presentWake=PTHREAD_COND_INITIALIZER, .sinkOutput={.scale=1}}
+
+static VegaVideoState videoDefault = VEGA_VIDEO_STATE_INIT;
+static __thread VegaVideoState * video __attribute__((tls_model("initial-exec"))) = &videoDefault; // The state of the context bound to the calling thread.
 
 VegaTime Vega_VideoGetAbsTime() {
     struct timespec spec;
-    clock_gettime(CLOCK_REALTIME, &spec);
-    return (VegaTime)spec.tv_sec + ((VegaTime)spec.tv_nsec / 1000000000.0l);
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+    return ((VegaTime)spec.tv_sec * 1000000000) + (VegaTime)spec.tv_nsec;
 }
 
-static inline VegaTime Vega_VideoGetTime() {
-    return Vega_VideoGetAbsTime()-startTime;
+static inline u64 Vega_VideoRasterTime(u32 line, u32 col) {
+    return (((video->rasterFrame * video->videoBackend.scanH) + line) * video->videoBackend.scanW) + col;
 }
 
-static inline void Vega_VideoSleep(VegaTime time) {
-    nanosleep(&(struct timespec){.tv_sec = (time_t)time, .tv_nsec = (long)(time - (VegaTime)((time_t)time))}, NULL);
+static void Vega_VideoSleepUntil(VegaTime deadline) {
+    struct timespec spec = {.tv_sec = (time_t)(deadline / 1000000000), .tv_nsec = (long)(deadline % 1000000000)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL) == EINTR);
 }
 
-void Vega_VideoInit(VegaVideoBackend backend) {
-    videoBackend = backend;
+static bool8 Vega_VideoWaitFrame() { // Returns true if the frame missed its deadline.
+    VegaTime now;
+    if (!video->frameInterval) return false;
+    video->frameDeadline += video->frameInterval;
+    now = Vega_VideoGetAbsTime();
+    if (now >= video->frameDeadline + video->frameInterval) { // More than a frame behind, so drop the missed deadlines instead of rushing through them.
+        video->frameDeadline = now;
+        return true;
+    }
+    Vega_TraceBegin(VEGA_TRACE_SLEEP, 0);
+    Vega_VideoSleepUntil(video->frameDeadline);
+    Vega_TraceEnd(VEGA_TRACE_SLEEP);
+    return now > video->frameDeadline;
+}
+
+static void Vega_VideoDecodeTile(LineWork * work, u16 tile, u8 * dst) { // The callbacks are counted in WORK.
+    u8 x, y, mask = (1 << VEGA_BACKEND_COLORDEPTH(video)) - 1;
+    work->calls[VEGA_VIDCB_TILE] += 64;
+    for (y = 0; y < 8; y++) {
+        for (x = 0; x < 8; x++) {
+            dst[(y * 8) + x] = VEGA_BACKEND_GETTILECOLOR(video)(tile, x, y) & mask;
+        }
+    }
+}
+
+static void Vega_VideoDecodeDirtyTiles() {
+    u32 i, bit;
+    Vega_TraceBegin(VEGA_TRACE_TILES, 0);
+    for (i = 0; i < ((VEGA_BACKEND_TILECOUNT(video) + 7) >> 3); i++) {
+        if (!video->tileCacheDirty[i]) continue;
+        for (bit = 0; bit < 8; bit++) {
+            if ((video->tileCacheDirty[i] & (1 << bit)) && ((i << 3) + bit) < VEGA_BACKEND_TILECOUNT(video)) Vega_VideoDecodeTile(&video->mainWork, (i << 3) + bit, &video->tileCache[((i << 3) + bit) * 64]);
+        }
+        video->tileCacheDirty[i] = 0;
+    }
+    video->tileCacheStale = false;
+    Vega_TraceEnd(VEGA_TRACE_TILES);
+}
+
+static inline const u8 * Vega_VideoGetTileRow(LineWork * work, u16 tile, u8 y) { // Dirty tiles are only decoded here when rendering on the calling thread.
+    VegaVideoState * const video = work->state; // Kept in a register, the thread-local would be looked up again after every callback.
+    u8 x;
+    if (tile >= VEGA_BACKEND_TILECOUNT(video)) {
+        work->calls[VEGA_VIDCB_TILE] += 8;
+        for (x = 0; x < 8; x++) {
+            work->tileScratch[x] = VEGA_BACKEND_GETTILECOLOR(video)(tile, x, y);
+        }
+        return work->tileScratch;
+    }
+    if (work == &video->mainWork && (video->tileCacheDirty[tile >> 3] & (1 << (tile & 7)))) { // Render threads find every tile decoded by Vega_VideoCaptureLine.
+        Vega_VideoDecodeTile(work, tile, &video->tileCache[tile * 64]);
+        video->tileCacheDirty[tile >> 3] &= ~(1 << (tile & 7));
+    }
+    if (work->tileUse) work->tileUse[tile >> 3] |= 1 << (tile & 7);
+    return &video->tileCache[(tile * 64) + (y * 8)];
+}
+
+static void Vega_VideoRefreshPaletteCache() {
+    u32 line, color, size = 1 << (video->videoBackend.paletteIndexDepth + video->videoBackend.colorIndexDepth);
+    VegaVideoColor value;
+    bool8 changed = false;
+    Vega_TraceBegin(VEGA_TRACE_PALETTES, 0);
+    if (video->journalPending) { // Captured lines still reference the current version, so the change goes into a copy.
+        memcpy(video->paletteCurrent + size, video->paletteCurrent, size * sizeof(VegaVideoColor));
+        video->paletteCurrent += size;
+    }
+    for (line = 0; line < (1 << video->videoBackend.paletteIndexDepth); line++) {
+        if (!video->paletteCacheDirty[line]) continue;
+        video->mainWork.calls[VEGA_VIDCB_PALETTE] += 1 << video->videoBackend.colorIndexDepth;
+        for (color = 0; color < (1 << video->videoBackend.colorIndexDepth); color++) {
+            value = video->videoBackend.getPaletteColor(line, color);
+            changed |= video->paletteCurrent[(line << video->videoBackend.colorIndexDepth) + color] != value;
+            video->paletteCurrent[(line << video->videoBackend.colorIndexDepth) + color] = value;
+        }
+        video->paletteCacheDirty[line] = false;
+    }
+    video->paletteSerial += changed;
+    if (video->clearColorDirty) {
+        video->clearColor = video->videoBackend.getClearColor();
+        video->mainWork.calls[VEGA_VIDCB_PALETTE]++;
+    }
+    video->clearColorDirty = false;
+    video->paletteCacheStale = false;
+    Vega_TraceEnd(VEGA_TRACE_PALETTES);
+}
+
+static inline VegaVideoColor Vega_VideoLookupColor(const VegaVideoState * video, const VegaVideoColor * palettes, u8 palette, u8 color) {
+    return palettes[((palette & ((1 << VEGA_BACKEND_PALETTEDEPTH(video)) - 1)) << VEGA_BACKEND_COLORDEPTH(video)) | (color & ((1 << VEGA_BACKEND_COLORDEPTH(video)) - 1))];
+}
+
+static void Vega_VideoFetchSprite(u16 slot) {
+    SpriteAttrib * spr = &video->spriteAttribs[slot];
+    video->mainWork.calls[VEGA_VIDCB_SPRITEATTRIB] += 6 + (video->videoBackend.getSpriteEnabled != NULL);
+    if (video->videoBackend.getSpriteEnabled && !video->videoBackend.getSpriteEnabled(spr->id)) {
+        spr->h = 0;
+        return;
+    }
+    spr->x = video->videoBackend.getSpriteX(spr->id);
+    spr->y = video->videoBackend.getSpriteY(spr->id);
+    spr->w = video->videoBackend.getSpriteW(spr->id);
+    spr->h = video->videoBackend.getSpriteH(spr->id);
+    spr->palette = video->videoBackend.getSpritePalette(spr->id);
+    spr->priority = video->videoBackend.getSpritePriority(spr->id) & ((1 << video->videoBackend.priorityIndexDepth) - 1);
+}
+
+static void Vega_VideoEvaluateSprites() {
+    u32 n;
+    u16 sprite;
+    Vega_TraceBegin(VEGA_TRACE_SPRITES, 0);
+    for (n = 0; n < video->videoBackend.spriteCount; n++) {
+        video->spriteSlots[n] = UINT16_MAX;
+    }
+    video->spriteAttribCount = 0;
+    if (video->videoBackend.getSpriteFirst) video->mainWork.calls[VEGA_VIDCB_SPRITEATTRIB]++;
+    if (video->videoBackend.spriteCount) {
+        sprite = video->videoBackend.getSpriteFirst ? video->videoBackend.getSpriteFirst() : video->videoBackend.spriteCount - 1;
+        for (n = 0; n < video->videoBackend.spriteCount && sprite < video->videoBackend.spriteCount; n++) { // Bounded so a looping chain can't hang the renderer.
+            video->mainWork.calls[VEGA_VIDCB_SPRITEATTRIB] += (video->videoBackend.getSpriteEnabled != NULL) + (video->videoBackend.getSpriteEnd != NULL) + (video->videoBackend.getSpriteLink != NULL);
+            if (video->spriteSlots[sprite] == UINT16_MAX && !(video->videoBackend.getSpriteEnabled && !video->videoBackend.getSpriteEnabled(sprite))) {
+                video->spriteSlots[sprite] = video->spriteAttribCount;
+                video->spriteAttribs[video->spriteAttribCount].id = sprite;
+                video->spriteAttribDirty[video->spriteAttribCount] = false;
+                Vega_VideoFetchSprite(video->spriteAttribCount++);
+            }
+            if (video->videoBackend.getSpriteEnd ? video->videoBackend.getSpriteEnd(sprite) : sprite == 0) break;
+            sprite = video->videoBackend.getSpriteLink ? video->videoBackend.getSpriteLink(sprite) : sprite - 1;
+        }
+    }
+    video->spriteCacheStale = false;
+    video->spriteBucketsStale = true;
+    Vega_TraceEnd(VEGA_TRACE_SPRITES);
+}
+
+static void Vega_VideoBuildSpriteBuckets() {
+    u32 i, line, end, count, total = 0;
+    u16 * buckets;
+    const SpriteAttrib * spr;
+    Vega_TraceBegin(VEGA_TRACE_SPRITES, 0);
+    for (i = 0; i < video->spriteAttribCount; i++) {
+        if (video->spriteAttribDirty[i]) Vega_VideoFetchSprite(i);
+        video->spriteAttribDirty[i] = false;
+    }
+    for (line = 0; line < video->videoBackend.screenH; line++) {
+        video->spriteBucketFill[line] = 0;
+    }
+    for (i = 0; i < video->spriteAttribCount; i++) { // Count the sprites drawn on each line, dropping any past the line limit.
+        spr = &video->spriteAttribs[i];
+        end = spr->y + spr->h;
+        if (end > video->videoBackend.screenH) end = video->videoBackend.screenH;
+        for (line = spr->y; line < end; line++) {
+            if (!video->videoBackend.spriteLineLimit || video->spriteBucketFill[line] < video->videoBackend.spriteLineLimit) video->spriteBucketFill[line]++;
+        }
+    }
+    for (line = 0; line < video->videoBackend.screenH; line++) {
+        count = video->spriteBucketFill[line];
+        video->spriteBucketStart[line] = video->spriteBucketFill[line] = total;
+        total += count;
+    }
+    video->spriteBucketStart[video->videoBackend.screenH] = total;
+    if (total > video->spriteBucketCap) {
+        buckets = realloc(video->spriteBuckets, total * sizeof(u16));
+        if (!buckets) { // No sprites are drawn until a later line manages the allocation.
+            perror("video sprite bucket allocation");
+            memset(video->spriteBucketStart, 0, (video->videoBackend.screenH + 1) * sizeof(u32));
+            Vega_TraceEnd(VEGA_TRACE_SPRITES);
+            return;
+        }
+        video->spriteBuckets = buckets;
+        video->spriteBucketCap = total;
+    }
+    for (i = 0; i < video->spriteAttribCount; i++) { // Sprites are visited in draw order, so each bucket keeps the first spriteLineLimit sprites.
+        spr = &video->spriteAttribs[i];
+        end = spr->y + spr->h;
+        if (end > video->videoBackend.screenH) end = video->videoBackend.screenH;
+        for (line = spr->y; line < end; line++) {
+            if (video->spriteBucketFill[line] < video->spriteBucketStart[line+1]) video->spriteBuckets[video->spriteBucketFill[line]++] = i;
+        }
+    }
+    video->spriteBucketsStale = false;
+    Vega_TraceEnd(VEGA_TRACE_SPRITES);
+}
+
+static inline u64 Vega_VideoMix(u64 hash, u64 value) { // FNV-1a over whole values.
+    return (hash ^ value) * 0x100000001B3ull;
+}
+
+static u64 Vega_VideoHashWords(const u16 * words, u32 count) {
+    u64 hash = 0xCBF29CE484222325ull;
+    u32 i;
+    for (i = 0; i < count; i++) {
+        hash = Vega_VideoMix(hash, words[i]);
+    }
+    return hash;
+}
+
+static void Vega_VideoRefreshPlaneCache(u8 plane) {
+    Vega_TraceBegin(VEGA_TRACE_PLANES, 0);
+    video->mainWork.calls[VEGA_VIDCB_PLANESCROLL] += (video->videoBackend.getPlaneHScrollTable != NULL) + (video->videoBackend.getPlaneVScrollTable != NULL);
+    if (video->videoBackend.getPlaneHScrollTable) video->videoBackend.getPlaneHScrollTable(plane, &video->hScrollTables[plane * video->videoBackend.screenH]);
+    if (video->videoBackend.getPlaneVScrollTable) video->videoBackend.getPlaneVScrollTable(plane, &video->vScrollTables[plane * video->videoBackend.screenW]);
+    if (video->incremental) video->vScrollHashes[plane] = Vega_VideoHashWords(&video->vScrollTables[plane * video->videoBackend.screenW], video->videoBackend.screenW);
+    video->planeCacheDirty[plane] = false;
+    Vega_TraceEnd(VEGA_TRACE_PLANES);
+}
+
+static void Vega_VideoSetupLineWork(LineWork * work) { // Called once the three line buffers are allocated.
+    work->layerColors = work->lineColors + video->videoBackend.screenW;
+    work->layerPriorities = work->linePriorities + video->videoBackend.screenW;
+    work->planePalettes = work->planeColors + video->videoBackend.screenW;
+    work->planePriorities = work->planePalettes + video->videoBackend.screenW;
+    memset(work->calls, 0, sizeof(work->calls));
+    memset(work->lineTimes, 0, sizeof(work->lineTimes));
+    work->lineTimeMax = 0;
+}
+
+static inline u64 Vega_VideoLineWorkSize() { // Bytes of line buffers per render thread, rounded up so no two threads share a cache line.
+    return ((u64)video->videoBackend.screenW * ((2 * sizeof(VegaVideoColor)) + 2 + 3) + VEGA_ARENA_LINE - 1) & ~(u64)(VEGA_ARENA_LINE - 1);
+}
+
+static void Vega_VideoCarveLineWork(LineWork * work, u8 * buffers) {
+    work->lineColors = (VegaVideoColor *)buffers;
+    work->linePriorities = buffers + (video->videoBackend.screenW * 2 * sizeof(VegaVideoColor));
+    work->planeColors = work->linePriorities + (video->videoBackend.screenW * 2);
+    Vega_VideoSetupLineWork(work);
+}
+
+static void Vega_VideoStopRenderThreads() { // Also frees the thread arrays when no thread was started.
+    u32 i;
+    pthread_mutex_lock(&video->renderLock);
+    video->renderQuit = true;
+    pthread_cond_broadcast(&video->renderWake);
+    pthread_mutex_unlock(&video->renderLock);
+    for (i = 0; i < video->renderThreadCount; i++) {
+        pthread_join(video->renderThreads[i], NULL);
+    }
+    free(video->renderWork);
+    free(video->renderThreads);
+    free(video->bandQueue);
+    free(video->renderBuffers);
+    video->renderWork = NULL;
+    video->renderThreads = NULL;
+    video->bandQueue = NULL;
+    video->renderBuffers = NULL;
+    video->renderThreadCount = 0;
+}
+
+#if RENDER_SDL
+static void * Vega_VideoPresentWorker(void * arg) {
+    Vega_ContextMakeCurrent(((VegaVideoState *)arg)->owner);
+    u8 index;
+    Vega_TraceNameThread("present", -1);
+    video->rend = SDL_CreateRenderer(video->win, -1, (SDL_RENDERER_ACCELERATED));
+    video->fBuf = SDL_CreateTexture(video->rend, SDL_PIXELFORMAT_RGBA5551, SDL_TEXTUREACCESS_STREAMING, video->videoBackend.screenW, video->videoBackend.screenH);
+    pthread_mutex_lock(&video->presentLock);
+    while (1) {
+        while (!video->presentQuit && !video->presentFresh) pthread_cond_wait(&video->presentWake, &video->presentLock);
+        if (video->presentQuit) break;
+        index = video->presentShown;
+        video->presentShown = video->presentReady;
+        video->presentReady = index;
+        video->presentFresh = false;
+        pthread_mutex_unlock(&video->presentLock);
+        Vega_TraceBegin(VEGA_TRACE_UPLOAD, 0);
+        SDL_UpdateTexture(video->fBuf, NULL, &video->presentBufs[video->presentShown * video->videoBackend.screenW * video->videoBackend.screenH], video->videoBackend.screenW * sizeof(VegaVideoColor));
+        SDL_RenderCopy(video->rend, video->fBuf, NULL, NULL);
+        SDL_RenderPresent(video->rend);
+        Vega_TraceEnd(VEGA_TRACE_UPLOAD);
+        pthread_mutex_lock(&video->presentLock);
+    }
+    pthread_mutex_unlock(&video->presentLock);
+    SDL_DestroyTexture(video->fBuf);
+    SDL_DestroyRenderer(video->rend);
+    video->fBuf = NULL;
+    video->rend = NULL;
+    return NULL;
+}
+
+static void Vega_VideoHandOffFrame() { // Makes the frame just drawn the newest one for the presentation thread and starts on the oldest free buffer.
+    u8 index;
+    pthread_mutex_lock(&video->presentLock);
+    index = video->presentReady;
+    video->presentReady = video->presentDrawn;
+    video->presentDrawn = index;
+    if (video->presentFresh) video->videoStats.skippedFrames++;
+    video->presentFresh = true;
+    pthread_cond_signal(&video->presentWake);
+    pthread_mutex_unlock(&video->presentLock);
+}
+#endif
+
+static void Vega_VideoStartPresentThread() {
+#if RENDER_SDL
+    video->presentDrawn = 0;
+    video->presentReady = 1;
+    video->presentShown = 2;
+    video->presentFresh = false;
+    video->presentQuit = false;
+    if (pthread_create(&video->presentThread, NULL, Vega_VideoPresentWorker, video)) {
+        perror("video presentation thread creation");
+        exit(0);
+    }
+#endif
+}
+
+static void Vega_VideoStopPresentThread() {
+    pthread_mutex_lock(&video->presentLock);
+    video->presentQuit = true;
+    pthread_cond_signal(&video->presentWake);
+    pthread_mutex_unlock(&video->presentLock);
+    pthread_join(video->presentThread, NULL);
+}
+
+static void Vega_VideoInitWindow() {
 #if RENDER_SDL
     if (SDL_Init(SDL_INIT_EVERYTHING)) {
         fprintf(stderr, "SDL failed to initalize.");
         exit(0);
     }
-    win = SDL_CreateWindow("Vega Engine", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, videoBackend.screenW*3, videoBackend.screenH*3, SDL_WINDOW_OPENGL);
-    rend = SDL_CreateRenderer(win, -1, (SDL_RENDERER_ACCELERATED));
-    fBuf = SDL_CreateTexture(rend, SDL_PIXELFORMAT_RGBA5551, SDL_TEXTUREACCESS_STREAMING, videoBackend.screenW, videoBackend.screenH);
+    video->win = SDL_CreateWindow("Vega Engine", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, video->videoBackend.screenW*3, video->videoBackend.screenH*3, SDL_WINDOW_OPENGL);
+    if (video->presentThreaded) return; // The renderer belongs to the thread that created it, so the presentation thread makes its own.
+    video->rend = SDL_CreateRenderer(video->win, -1, (SDL_RENDERER_ACCELERATED));
+    video->fBuf = SDL_CreateTexture(video->rend, SDL_PIXELFORMAT_RGBA5551, SDL_TEXTUREACCESS_STREAMING, video->videoBackend.screenW, video->videoBackend.screenH);
 #elif RENDER_GLFW
     if (!glfwInit()) {
         fprintf(stderr, "GLFW failed to initalize.");
         exit(0);
     }
-    win = glfwCreateWindow(videoBackend.screenW*3, videoBackend.screenH*3, "Vega Engine", NULL, NULL);
-    glfwMakeContextCurrent(win);
-
-    fragShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragShader, 1, &VegaFragShader, NULL);
-    glCompileShader(fragShader);
-    vertShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertShader, 1, &VegaVertShader, NULL);
-    glCompileShader(vertShader);
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertShader);
-    glAttachShader(shaderProgram, fragShader);
-    glLinkProgram(shaderProgram);
-    glDeleteShader(fragShader);
-    glDeleteShader(vertShader);
-
-    glGenTextures(1, &paletteTexture);
-    glBindTexture(GL_TEXTURE_2D, paletteTexture);
+    video->win = glfwCreateWindow(video->videoBackend.screenW*3, video->videoBackend.screenH*3, "Vega Engine", NULL, NULL);
+    glfwMakeContextCurrent(video->win);
+
+    video->fragShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(video->fragShader, 1, &VegaFragShader, NULL);
+    glCompileShader(video->fragShader);
+    video->vertShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(video->vertShader, 1, &VegaVertShader, NULL);
+    glCompileShader(video->vertShader);
+    video->shaderProgram = glCreateProgram();
+    glAttachShader(video->shaderProgram, video->vertShader);
+    glAttachShader(video->shaderProgram, video->fragShader);
+    glLinkProgram(video->shaderProgram);
+    glDeleteShader(video->fragShader);
+    glDeleteShader(video->vertShader);
+
+    glGenTextures(1, &video->paletteTexture);
+    glBindTexture(GL_TEXTURE_2D, video->paletteTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5_A1, 1 << videoBackend.colorIndexDepth, 1 << videoBackend.paletteIndexDepth, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB5_A1, 1 << video->videoBackend.colorIndexDepth, 1 << video->videoBackend.paletteIndexDepth, 0, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, NULL);
     
-    glGenTextures(1, &tileTexture);
-    glBindTexture(GL_TEXTURE_2D, tileTexture);
+    glGenTextures(1, &video->tileTexture);
+    glBindTexture(GL_TEXTURE_2D, video->tileTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 8, 8 * (1 << videoBackend.paletteIndexDepth), 0, GL_R, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 8, 8 * (1 << video->videoBackend.paletteIndexDepth), 0, GL_R, GL_UNSIGNED_BYTE, NULL);
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &video->VBO);
 
     glVertexAttribPointer(0, 3, GL_UNSIGNED_INT, GL_FALSE, 6 * sizeof(uint), (void *)0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 2, GL_UNSIGNED_INT, GL_FALSE, 6 * sizeof(uint), (void *)(3 * sizeof(uint)));
     glEnableVertexAttribArray(1);  
     glVertexAttribPointer(2, 1, GL_UNSIGNED_INT, GL_FALSE, 6 * sizeof(uint), (void *)(5 * sizeof(uint)));
-    glEnableVertexAttribArray(2);  
+    glEnableVertexAttribArray(2);
 #endif
-    memLocs = malloc(videoBackend.memLocCount * sizeof(void *));
-    for (int i = 0; i < videoBackend.memLocCount; i++) {
-        memLocs[i] = calloc(videoBackend.memLocSizes[i], 1);
-    }
-    if (videoBackend.initCB) videoBackend.initCB();
-    startTime = Vega_VideoGetAbsTime();
 }
+
+static inline u32 Vega_VideoDirtyWords(u32 size) {
+    return ((size + VEGA_VIDMEM_DIRTYBLOCK - 1) / VEGA_VIDMEM_DIRTYBLOCK + 63) >> 6;
+}
+
+static void * Vega_VideoArenaCarve(u64 * offset, u64 size, u64 align) { // Reserves SIZE bytes at the next multiple of ALIGN. Returns NULL until the arena exists.
+    u64 at = (*offset + align - 1) & ~(align - 1);
+    *offset = at + size;
+    return video->arena ? video->arena + at : NULL;
+}
+
+static inline bool8 Vega_VideoUsesPresentThread() {
 #if RENDER_SDL
-void Vega_RenderLine(u32 line, volatile VegaVideoColor * pixels, volatile u32 pitch) { // TODO: Fix the nested code, please.
-    volatile u32 col, tile, plane, x, y, count, prio;
-    VegaVideoColor color;
-    if (videoBackend.shouldBlankLine && videoBackend.shouldBlankLine(line)) {
-        for (col = 0; col < videoBackend.screenW-1; col++) {
-            pixels[col+(line*videoBackend.screenW)] = videoBackend.getClearColor();
+    return video->presentThreaded && video->videoMode != VEGA_VIDMODE_HEADLESS;
+#else
+    return false;
+#endif
+}
+
+static u64 Vega_VideoLayoutArena() { // Points every fixed-size buffer into the arena and returns its size. Run once to size the arena, then again to carve it.
+    u64 offset = 0, areas = 0;
+    u32 i, colors = 1 << (video->videoBackend.paletteIndexDepth + video->videoBackend.colorIndexDepth);
+    void * area;
+    for (i = 0; i < video->videoBackend.memLocCount; i++) { // Only the memory areas may outlive a FILE or SHM arena, their bookkeeping holds pointers.
+        Vega_VideoArenaCarve(&offset, video->videoBackend.memLocSizes[i], VEGA_ARENA_PAGE);
+    }
+    video->arenaAreasEnd = offset;
+    video->memLocs = Vega_VideoArenaCarve(&offset, video->videoBackend.memLocCount * sizeof(void *), VEGA_ARENA_LINE);
+    video->memLocSizes = Vega_VideoArenaCarve(&offset, video->videoBackend.memLocCount * sizeof(u32), VEGA_ARENA_LINE);
+    video->memLocOwned = Vega_VideoArenaCarve(&offset, video->videoBackend.memLocCount * sizeof(bool8), VEGA_ARENA_LINE);
+    video->memLocDirty = Vega_VideoArenaCarve(&offset, video->videoBackend.memLocCount * sizeof(u64 *), VEGA_ARENA_LINE);
+    video->memLocHome = Vega_VideoArenaCarve(&offset, video->videoBackend.memLocCount * sizeof(void *), VEGA_ARENA_LINE);
+    video->memLocHomeDirty = Vega_VideoArenaCarve(&offset, video->videoBackend.memLocCount * sizeof(u64 *), VEGA_ARENA_LINE);
+    for (i = 0; i < video->videoBackend.memLocCount; i++) {
+        area = Vega_VideoArenaCarve(&areas, video->videoBackend.memLocSizes[i], VEGA_ARENA_PAGE);
+        if (video->arena) video->memLocHome[i] = area;
+    }
+    for (i = 0; i < video->videoBackend.memLocCount; i++) {
+        area = Vega_VideoArenaCarve(&offset, Vega_VideoDirtyWords(video->videoBackend.memLocSizes[i]) * sizeof(u64), VEGA_ARENA_LINE);
+        if (video->arena) video->memLocHomeDirty[i] = area;
+    }
+    video->frameBuf = Vega_VideoArenaCarve(&offset, video->videoBackend.screenW * video->videoBackend.screenH * sizeof(VegaVideoColor), VEGA_ARENA_PAGE);
+    video->presentBufs = Vega_VideoArenaCarve(&offset, Vega_VideoUsesPresentThread() ? 3 * video->videoBackend.screenW * video->videoBackend.screenH * sizeof(VegaVideoColor) : 0, VEGA_ARENA_PAGE);
+    video->mainWork.lineColors = Vega_VideoArenaCarve(&offset, video->videoBackend.screenW * 2 * sizeof(VegaVideoColor), VEGA_ARENA_LINE);
+    video->mainWork.linePriorities = Vega_VideoArenaCarve(&offset, video->videoBackend.screenW * 2, VEGA_ARENA_LINE);
+    video->mainWork.planeColors = Vega_VideoArenaCarve(&offset, video->videoBackend.screenW * 3, VEGA_ARENA_LINE);
+    video->hScrollTables = Vega_VideoArenaCarve(&offset, video->videoBackend.planeCount * video->videoBackend.screenH * sizeof(u16), VEGA_ARENA_LINE);
+    video->vScrollTables = Vega_VideoArenaCarve(&offset, video->videoBackend.planeCount * video->videoBackend.screenW * sizeof(u16), VEGA_ARENA_LINE);
+    video->planeCacheDirty = Vega_VideoArenaCarve(&offset, video->videoBackend.planeCount * sizeof(bool8), VEGA_ARENA_LINE);
+    video->tileCache = Vega_VideoArenaCarve(&offset, video->videoBackend.tileCount * 64, VEGA_ARENA_LINE);
+    video->tileCacheDirty = Vega_VideoArenaCarve(&offset, (video->videoBackend.tileCount + 7) >> 3, VEGA_ARENA_LINE);
+    video->paletteCacheHome = Vega_VideoArenaCarve(&offset, colors * sizeof(VegaVideoColor), VEGA_ARENA_LINE);
+    video->paletteCacheDirty = Vega_VideoArenaCarve(&offset, 1 << video->videoBackend.paletteIndexDepth, VEGA_ARENA_LINE);
+    video->spriteAttribs = Vega_VideoArenaCarve(&offset, video->videoBackend.spriteCount * sizeof(SpriteAttrib), VEGA_ARENA_LINE);
+    video->spriteSlots = Vega_VideoArenaCarve(&offset, video->videoBackend.spriteCount * sizeof(u16), VEGA_ARENA_LINE);
+    video->spriteAttribDirty = Vega_VideoArenaCarve(&offset, video->videoBackend.spriteCount * sizeof(bool8), VEGA_ARENA_LINE);
+    video->spriteBucketStart = Vega_VideoArenaCarve(&offset, (video->videoBackend.screenH + 1) * sizeof(u32), VEGA_ARENA_LINE);
+    video->spriteBucketFill = Vega_VideoArenaCarve(&offset, video->videoBackend.screenH * sizeof(u32), VEGA_ARENA_LINE);
+    video->lineJournal = Vega_VideoArenaCarve(&offset, video->videoBackend.screenH * sizeof(LineState), VEGA_ARENA_LINE);
+    video->lineHashes = Vega_VideoArenaCarve(&offset, video->videoBackend.screenH * sizeof(u64), VEGA_ARENA_LINE);
+    video->lineForced = Vega_VideoArenaCarve(&offset, video->videoBackend.screenH * sizeof(bool8), VEGA_ARENA_LINE);
+    video->lineTileUse = Vega_VideoArenaCarve(&offset, video->videoBackend.screenH * ((video->videoBackend.tileCount + 7) >> 3), VEGA_ARENA_LINE);
+    video->tileChanged = Vega_VideoArenaCarve(&offset, (video->videoBackend.tileCount + 7) >> 3, VEGA_ARENA_LINE);
+    video->vScrollHashes = Vega_VideoArenaCarve(&offset, video->videoBackend.planeCount * sizeof(u64), VEGA_ARENA_LINE);
+    video->planeJournal = Vega_VideoArenaCarve(&offset, video->videoBackend.screenH * video->videoBackend.planeCount * sizeof(PlaneLineState), VEGA_ARENA_LINE);
+    return (offset + VEGA_ARENA_PAGE - 1) & ~(u64)(VEGA_ARENA_PAGE - 1);
+}
+
+static void Vega_VideoAllocArena(u64 size) { // Leaves everything above arenaAreasEnd cleared.
+    int fd;
+    void * map;
+    u8 * start;
+    u64 length;
+    video->arenaSize = size;
+    video->arenaMapSize = 0;
+    if ((video->arenaType == VEGA_ARENA_FILE || video->arenaType == VEGA_ARENA_SHM) && video->arenaPath) {
+        fd = (video->arenaType == VEGA_ARENA_SHM) ? shm_open(video->arenaPath, O_RDWR | O_CREAT, 0600) : open(video->arenaPath, O_RDWR | O_CREAT, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)size)) {
+            perror("video arena backing");
+        } else {
+            map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (map == MAP_FAILED) {
+                perror("video arena mapping");
+            } else {
+                video->arena = map;
+                video->arenaMapSize = size;
+                memset(video->arena + video->arenaAreasEnd, 0, size - video->arenaAreasEnd); // The memory areas keep what the file held.
+            }
+        }
+        if (fd >= 0) close(fd);
+        if (video->arena) return;
+    } else if (video->arenaType == VEGA_ARENA_HUGEPAGES) {
+        length = (size + VEGA_ARENA_HUGEPAGE - 1) & ~(u64)(VEGA_ARENA_HUGEPAGE - 1);
+        map = mmap(NULL, length + VEGA_ARENA_HUGEPAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            perror("video arena mapping");
+        } else { // Trimmed to a huge page boundary so the kernel can back it with huge pages from the start.
+            start = (u8 *)(((uintptr_t)map + VEGA_ARENA_HUGEPAGE - 1) & ~(uintptr_t)(VEGA_ARENA_HUGEPAGE - 1));
+            if (start != (u8 *)map) munmap(map, start - (u8 *)map);
+            munmap(start + length, VEGA_ARENA_HUGEPAGE - (start - (u8 *)map));
+            madvise(start, length, MADV_HUGEPAGE);
+            video->arena = start;
+            video->arenaMapSize = length;
+            return;
         }
+    }
+    if (posix_memalign(&map, VEGA_ARENA_PAGE, size)) {
+        perror("video arena allocation");
         return;
     }
-    for (col = 0; col < videoBackend.scanW; col++) {
-        if (col == videoBackend.screenW && videoBackend.hBlankCB) videoBackend.hBlankCB(line);
-        else if (col < videoBackend.screenW-1) {
-            for (prio = 0; prio < (1 << videoBackend.priorityIndexDepth)-1; prio++) {
-                linebufget(col, prio) = 0;
+    video->arena = map;
+    memset(video->arena, 0, size);
+}
+
+static void Vega_VideoFreeArena() {
+    if (video->arenaMapSize) munmap(video->arena, video->arenaMapSize);
+    else free(video->arena);
+    video->arena = NULL;
+    video->arenaSize = video->arenaMapSize = 0;
+}
+
+static void Vega_VideoAttachMemLoc(u8 index, void * buffer, u32 size) {
+    if (!video->memLocOwned[index]) free(video->memLocDirty[index]);
+    if (buffer) {
+        video->memLocs[index] = buffer;
+        video->memLocSizes[index] = size;
+        video->memLocOwned[index] = false;
+        video->memLocDirty[index] = calloc(Vega_VideoDirtyWords(size), sizeof(u64));
+        if (!video->memLocDirty[index] && size) perror("video memory area allocation");
+    } else {
+        video->memLocs[index] = video->memLocHome[index];
+        video->memLocSizes[index] = video->videoBackend.memLocSizes[index];
+        video->memLocOwned[index] = true;
+        video->memLocDirty[index] = video->memLocHomeDirty[index];
+        memset(video->memLocDirty[index], 0, Vega_VideoDirtyWords(video->memLocSizes[index]) * sizeof(u64));
+    }
+    Vega_VideoMarkMemLoc(index, 0, video->memLocSizes[index]);
+}
+
+void Vega_VideoInit(VegaVideoBackend backend) {
+    Vega_VideoInitMode(backend, VEGA_VIDMODE_WINDOW);
+}
+
+void Vega_VideoInitMode(VegaVideoBackend backend, VegaVideoMode mode) {
+    if (!Vega_BackendMatchesStatic(&backend)) {
+        fprintf(stderr, "The video backend does not match the one the engine was specialized for.");
+        exit(0);
+    }
+    video->videoBackend = backend;
+    video->videoMode = mode;
+    Vega_SimdInit();
+    if (video->videoMode != VEGA_VIDMODE_HEADLESS) Vega_VideoInitWindow();
+    Vega_VideoAllocArena(Vega_VideoLayoutArena());
+    Vega_VideoLayoutArena();
+    if (Vega_VideoUsesPresentThread()) Vega_VideoStartPresentThread();
+    for (int i = 0; i < video->videoBackend.memLocCount; i++) {
+        Vega_VideoAttachMemLoc(i, NULL, 0);
+    }
+    Vega_VideoSetupLineWork(&video->mainWork);
+    video->mainWork.state = video;
+    memset(video->tileCacheDirty, 0xFF, (video->videoBackend.tileCount + 7) >> 3);
+    video->tileCacheStale = true;
+    video->paletteCache = video->paletteCurrent = video->paletteCacheHome;
+    memset(video->paletteCacheDirty, true, 1 << video->videoBackend.paletteIndexDepth);
+    video->paletteCacheStale = true;
+    video->clearColorDirty = true;
+    memset(video->spriteSlots, 0xFF, video->videoBackend.spriteCount * sizeof(u16)); // No sprite has a slot until the chain is first walked.
+    video->spriteAttribCount = 0;
+    video->spriteCacheStale = true;
+    memset(video->lineForced, true, video->videoBackend.screenH);
+    video->tileChangedStale = false;
+    video->frameInterval = (video->videoMode == VEGA_VIDMODE_HEADLESS) ? 0 : 1000000000 / 60;
+    memset(&video->videoStats, 0, sizeof(VegaVideoStats));
+    video->rasterFrame = 0;
+    video->rasterNow = 0;
+    if (video->videoBackend.initCB) video->videoBackend.initCB();
+}
+
+static u8 Vega_VideoClipSpans(const VegaVideoSpan * a, u8 aCount, const VegaVideoSpan * b, u8 bCount, VegaVideoSpan * dst) { // Writes the columns in both lists to DST, at most aCount + bCount - 1 spans.
+    u8 i = 0, j = 0, count = 0;
+    u16 start, end;
+    while (i < aCount && j < bCount) {
+        start = (a[i].start > b[j].start) ? a[i].start : b[j].start;
+        end = (a[i].end < b[j].end) ? a[i].end : b[j].end;
+        if (start < end) dst[count++] = (VegaVideoSpan){.start=start, .end=end};
+        if (a[i].end < b[j].end) i++;
+        else j++;
+    }
+    return count;
+}
+
+static void Vega_RenderPlane(LineWork * work, const LineState * st, const PlaneLineState * pst, u8 plane, u32 line, const VegaVideoSpan * spans, u8 spanCount) { // Only draws the columns in SPANS.
+    VegaVideoState * const video = work->state;
+    u32 col, tile, x, y, tileX = UINT32_MAX, tileY = UINT32_MAX;
+    u8 palette = 0, priority = 0, priorityMask = (1 << VEGA_BACKEND_PRIORITYDEPTH(video)) - 1, i;
+    VegaVideoColor * colors = work->layerColors;
+    u8 * priorities = work->layerPriorities;
+    const u16 * vscroll = NULL;
+    const u8 * row = NULL;
+    if (VEGA_BACKEND_HASPLANELINE(video)) {
+        VEGA_BACKEND_GETPLANELINE(video)(plane, line, work->planeColors, work->planePalettes, work->planePriorities);
+        work->calls[VEGA_VIDCB_PLANELINE]++;
+        for (i = 0; i < spanCount; i++) {
+            for (col = spans[i].start; col < spans[i].end; col++) {
+                colors[col] = Vega_VideoLookupColor(video, st->palette, work->planePalettes[col], work->planeColors[col]);
+                priorities[col] = work->planePriorities[col] & priorityMask;
+            }
+            Vega_Simd.mergeLine(&work->lineColors[spans[i].start], &work->linePriorities[spans[i].start], &colors[spans[i].start], &priorities[spans[i].start], spans[i].end - spans[i].start);
+        }
+        return;
+    }
+    if (video->videoBackend.getPlaneVScrollTable) vscroll = &video->vScrollTables[plane * VEGA_BACKEND_SCREENW(video)];
+    for (i = 0; i < spanCount; i++) {
+        if (!vscroll) work->calls[VEGA_VIDCB_PLANESCROLL] += spans[i].end - spans[i].start;
+        for (col = spans[i].start; col < spans[i].end; col++) {
+            x = (col-pst->hscroll) % pst->hmod;
+            y = (line-(vscroll ? vscroll[col] : VEGA_BACKEND_GETPLANEVSCROLL(video)(plane, col))) % pst->vmod;
+            if ((x >> 3) != tileX || y != tileY) { // Tile attributes only change on a tile boundary or when the column scroll does.
+                tileX = x >> 3;
+                tileY = y;
+                tile = VEGA_BACKEND_GETPLANETILEID(video)(plane, x, y);
+                palette = VEGA_BACKEND_GETPLANETILEPALETTE(video)(plane, x, y);
+                priority = VEGA_BACKEND_GETPLANETILEPRIORITY(video)(plane, x, y) & priorityMask;
+                work->calls[VEGA_VIDCB_PLANETILE] += 3;
+                row = Vega_VideoGetTileRow(work, tile, y & 7);
+            }
+            colors[col] = Vega_VideoLookupColor(video, st->palette, palette, row[x & 7]);
+            priorities[col] = priority;
+        }
+        Vega_Simd.mergeLine(&work->lineColors[spans[i].start], &work->linePriorities[spans[i].start], &colors[spans[i].start], &priorities[spans[i].start], spans[i].end - spans[i].start);
+    }
+}
+
+static void Vega_RenderSprites(LineWork * work, const LineState * st, u32 line) {
+    VegaVideoState * const video = work->state;
+    u32 col, start, end, i;
+    u8 span;
+    VegaVideoColor * colors = work->layerColors;
+    const SpriteAttrib * spr;
+    for (i = video->spriteBucketStart[line]; i < video->spriteBucketStart[line+1]; i++) {
+        spr = &video->spriteAttribs[video->spriteBuckets[i]];
+        for (span = 0; span < st->visibleCount; span++) {
+            start = (spr->x > st->visible[span].start) ? spr->x : st->visible[span].start;
+            end = ((u32)spr->x + spr->w < st->visible[span].end) ? (u32)spr->x + spr->w : st->visible[span].end;
+            if (start >= end) continue;
+            work->calls[VEGA_VIDCB_SPRITECOLOR] += end - start;
+            for (col = start; col < end; col++) {
+                colors[col - start] = Vega_VideoLookupColor(video, st->palette, spr->palette, VEGA_BACKEND_GETSPRITECOLOR(video)(spr->id, col - spr->x, line - spr->y));
             }
-            for (plane = 0; plane < videoBackend.planeCount; plane++) {
-                if (videoBackend.getPlaneEnabled && !videoBackend.getPlaneEnabled(plane)) continue;
-                x = (col-videoBackend.getPlaneHScroll(plane, line)) % videoBackend.getPlaneHMod(plane);
-                y = (line-videoBackend.getPlaneVScroll(plane, col)) % videoBackend.getPlaneVMod(plane);
-                tile = videoBackend.getPlaneTileID(plane, x, y);
-                color = videoBackend.getPaletteColor(videoBackend.getPlaneTilePalette(plane, x, y), videoBackend.getTileColor(tile, x & 7, y & 7));
-                if ((color & 1)) linebufget(col, videoBackend.getPlaneTilePriority(plane, x, y)) = color;
+            Vega_Simd.mergeSpan(&work->lineColors[start], &work->linePriorities[start], colors, spr->priority, end - start);
+        }
+    }
+}
+
+static void Vega_RenderLine(LineWork * work, u32 line, VegaVideoColor * frame, u32 pitch) { // Only reads state captured by Vega_VideoCaptureLine, so it may run on any thread.
+    VegaVideoState * const video = work->state;
+    u32 col, plane;
+    u8 span, spanCount;
+    VegaVideoSpan spans[(VEGA_VIDSPAN_MAX * 2) + 1];
+    VegaVideoColor * pixels = (VegaVideoColor *)((u8 *)frame + (line*pitch));
+    const LineState * st = &video->lineJournal[line];
+    const PlaneLineState * pst = &video->planeJournal[line * VEGA_BACKEND_PLANECOUNT(video)];
+    work->tileUse = (video->incremental && VEGA_BACKEND_TILECOUNT(video)) ? &video->lineTileUse[line * ((VEGA_BACKEND_TILECOUNT(video) + 7) >> 3)] : NULL;
+    if (work->tileUse) memset(work->tileUse, 0, (VEGA_BACKEND_TILECOUNT(video) + 7) >> 3);
+    if (st->blank) {
+        for (col = 0; col < VEGA_BACKEND_SCREENW(video); col++) {
+            pixels[col] = st->clearColor;
+        }
+        return;
+    }
+    memset(work->lineColors, 0, VEGA_BACKEND_SCREENW(video) * sizeof(VegaVideoColor));
+    memset(work->linePriorities, 0, VEGA_BACKEND_SCREENW(video));
+    for (plane = 0; plane < VEGA_BACKEND_PLANECOUNT(video); plane++) {
+        if (!pst[plane].enabled) continue;
+        spanCount = Vega_VideoClipSpans(st->visible, st->visibleCount, pst[plane].window, pst[plane].windowCount, spans);
+        if (spanCount) Vega_RenderPlane(work, st, &pst[plane], plane, line, spans, spanCount);
+    }
+    Vega_RenderSprites(work, st, line);
+    if (VEGA_BACKEND_HASBLANKPIXEL(video)) {
+        for (span = 0; span < st->visibleCount; span++) {
+            work->calls[VEGA_VIDCB_BLANK] += st->visible[span].end - st->visible[span].start;
+            for (col = st->visible[span].start; col < st->visible[span].end; col++) {
+                if (VEGA_BACKEND_SHOULDBLANKPIXEL(video)(line, col)) work->lineColors[col] = 0;
             }
         }
     }
-    if (videoBackend.getSpriteFirst) count = videoBackend.getSpriteFirst(); 
-    else count = videoBackend.spriteCount;
+    Vega_Simd.resolveLine(pixels, work->lineColors, st->clearColor, VEGA_BACKEND_SCREENW(video));
+}
+
+static void Vega_VideoTimeLine(LineWork * work, VegaTime time) {
+    u32 bucket = (time >> 9) ? 64 - __builtin_clzll(time >> 9) : 0;
+    work->lineTimes[(bucket < VEGA_VIDSTATS_LINEBUCKETS) ? bucket : VEGA_VIDSTATS_LINEBUCKETS - 1]++;
+    if (time > work->lineTimeMax) work->lineTimeMax = time;
+}
+
+static void * Vega_VideoRenderWorker(void * arg) {
+    LineWork * work = arg;
+    Vega_ContextMakeCurrent(work->state->owner); // Pixel callbacks may use the context's IO and audio state too.
+    u32 line, start, end;
+    VegaTime lineStart, lineEnd;
+    Vega_TraceNameThread("render", (s32)(work - video->renderWork));
+    pthread_mutex_lock(&video->renderLock);
     while (1) {
-        if (!(videoBackend.getSpriteEnabled && !videoBackend.getSpriteEnabled(count))) {
-            if (line >= videoBackend.getSpriteY(count) && line < videoBackend.getSpriteY(count)+videoBackend.getSpriteH(count)) {
-                for (col = videoBackend.getSpriteX(count); col < videoBackend.getSpriteX(count)+videoBackend.getSpriteW(count); col++) {
-                    x = col - videoBackend.getSpriteX(count);
-                    y = line - videoBackend.getSpriteY(count);
-                    color = videoBackend.getPaletteColor(videoBackend.getSpritePalette(count), videoBackend.getSpriteColor(count, x, y));
-                    if (color & 1) linebufget(col, videoBackend.getSpritePriority(count)) = color;
-                }
+        while (!video->renderQuit && video->bandTaken == video->bandQueued) pthread_cond_wait(&video->renderWake, &video->renderLock);
+        if (video->renderQuit) break;
+        start = video->bandQueue[video->bandTaken % video->videoBackend.screenH].start;
+        end = video->bandQueue[video->bandTaken % video->videoBackend.screenH].end;
+        video->bandTaken++;
+        pthread_mutex_unlock(&video->renderLock);
+        Vega_TraceBegin(VEGA_TRACE_BAND, start);
+        lineStart = Vega_VideoGetAbsTime();
+        for (line = start; line < end; line++) {
+            if (video->lineJournal[line].reuse) continue;
+            Vega_TraceBegin(VEGA_TRACE_LINE, line);
+            Vega_RenderLine(work, line, video->renderPixels, video->renderPitch);
+            Vega_TraceEnd(VEGA_TRACE_LINE);
+            lineEnd = Vega_VideoGetAbsTime();
+            Vega_VideoTimeLine(work, lineEnd - lineStart);
+            lineStart = lineEnd;
+        }
+        Vega_TraceEnd(VEGA_TRACE_BAND);
+        pthread_mutex_lock(&video->renderLock);
+        if (++video->bandDone == video->bandQueued) pthread_cond_signal(&video->renderDone);
+    }
+    pthread_mutex_unlock(&video->renderLock);
+    return NULL;
+}
+
+static void Vega_VideoDispatchLines(u32 end) {
+    if (video->bandStart >= end) return;
+    pthread_mutex_lock(&video->renderLock);
+    video->bandQueue[video->bandQueued % video->videoBackend.screenH] = (LineBand){.start=video->bandStart, .end=end};
+    video->bandQueued++;
+    pthread_cond_signal(&video->renderWake);
+    pthread_mutex_unlock(&video->renderLock);
+    video->bandStart = end;
+}
+
+static void Vega_VideoFlushLines() {
+    if (!video->renderThreadCount) return;
+    Vega_VideoDispatchLines(video->bandEnd);
+    Vega_TraceBegin(VEGA_TRACE_FLUSH, 0);
+    pthread_mutex_lock(&video->renderLock);
+    while (video->bandDone != video->bandQueued) pthread_cond_wait(&video->renderDone, &video->renderLock);
+    pthread_mutex_unlock(&video->renderLock);
+    Vega_TraceEnd(VEGA_TRACE_FLUSH);
+    video->journalPending = false;
+}
+
+static void Vega_VideoFlushMemDirty() { // Hands each run of dirty blocks to memDirtyCB and clears them.
+    u32 index, block, blocks, start, end;
+    u64 * bits;
+    Vega_TraceBegin(VEGA_TRACE_MEMDIRTY, 0);
+    video->memLocStale = false;
+    for (index = 0; index < video->videoBackend.memLocCount; index++) {
+        bits = video->memLocDirty[index];
+        blocks = (video->memLocSizes[index] + VEGA_VIDMEM_DIRTYBLOCK - 1) / VEGA_VIDMEM_DIRTYBLOCK;
+        start = UINT32_MAX;
+        for (block = 0; block <= blocks; block++) {
+            if (block < blocks && start == UINT32_MAX && !(block & 63) && !bits[block >> 6]) { // Skip clean words.
+                block += 63;
+                continue;
+            }
+            if (block < blocks && (bits[block >> 6] >> (block & 63)) & 1) {
+                if (start == UINT32_MAX) start = block;
+            } else if (start != UINT32_MAX) {
+                end = block * VEGA_VIDMEM_DIRTYBLOCK;
+                if (end > video->memLocSizes[index]) end = video->memLocSizes[index];
+                video->videoBackend.memDirtyCB(index, start * VEGA_VIDMEM_DIRTYBLOCK, end - start * VEGA_VIDMEM_DIRTYBLOCK);
+                video->mainWork.calls[VEGA_VIDCB_EVENT]++;
+                start = UINT32_MAX;
             }
         }
-        if (videoBackend.getSpriteLink) {
-            count = videoBackend.getSpriteLink(count);
-        } else {
-            count--;
+        memset(bits, 0, ((blocks + 63) >> 6) * sizeof(u64));
+    }
+    Vega_TraceEnd(VEGA_TRACE_MEMDIRTY);
+}
+
+static void Vega_VideoResolveTileChanges() { // Forces every line that drew a changed tile. The render threads must be idle.
+    u32 line, i, bytes = (video->videoBackend.tileCount + 7) >> 3;
+    const u8 * use;
+    for (line = 0; line < video->videoBackend.screenH; line++) {
+        use = &video->lineTileUse[line * bytes];
+        for (i = 0; i < bytes && !video->lineForced[line]; i++) {
+            if (use[i] & video->tileChanged[i]) video->lineForced[line] = true;
         }
-        if (videoBackend.getSpriteEnd) {
-            if (videoBackend.getSpriteEnd(count)) break;
-        } else {
-            if (!count) break;
+    }
+    memset(video->tileChanged, 0, bytes);
+    video->tileChangedStale = false;
+}
+
+static u8 Vega_VideoTrimSpans(VegaVideoSpan * spans, u8 count) { // Clips backend spans to the line and drops the empty and out of order ones.
+    u8 i, kept = 0;
+    u16 end = 0;
+    if (count > VEGA_VIDSPAN_MAX) count = VEGA_VIDSPAN_MAX;
+    for (i = 0; i < count; i++) {
+        if (spans[i].start < end) spans[i].start = end;
+        if (spans[i].end > video->videoBackend.screenW) spans[i].end = video->videoBackend.screenW;
+        if (spans[i].start >= spans[i].end) continue;
+        end = spans[i].end;
+        spans[kept++] = spans[i];
+    }
+    return kept;
+}
+
+static void Vega_VideoCaptureBlankSpans(LineState * st, u32 line) { // Keeps the columns between the blanked spans.
+    VegaVideoSpan blank[VEGA_VIDSPAN_MAX];
+    u8 i, count = Vega_VideoTrimSpans(blank, video->videoBackend.getBlankSpans(line, blank));
+    u16 start = 0;
+    video->mainWork.calls[VEGA_VIDCB_BLANK]++;
+    st->visibleCount = 0;
+    for (i = 0; i < count; i++) {
+        if (blank[i].start > start) st->visible[st->visibleCount++] = (VegaVideoSpan){.start=start, .end=blank[i].start};
+        start = blank[i].end;
+    }
+    if (start < video->videoBackend.screenW) st->visible[st->visibleCount++] = (VegaVideoSpan){.start=start, .end=video->videoBackend.screenW};
+}
+
+static void Vega_VideoCaptureLine(u32 line) {
+    LineState * st = &video->lineJournal[line];
+    PlaneLineState * pst = &video->planeJournal[line * video->videoBackend.planeCount];
+    u32 plane;
+    bool8 stale;
+    if (video->memLocStale) Vega_VideoFlushMemDirty(); // Lets the backend turn memory changes into cache updates before they are checked.
+    stale = video->tileCacheStale || video->spriteCacheStale || video->spriteBucketsStale;
+    for (plane = 0; plane < video->videoBackend.planeCount; plane++) {
+        stale |= video->planeCacheDirty[plane];
+    }
+    if (stale && video->journalPending) Vega_VideoFlushLines(); // Lines already captured must be drawn with the old plane, sprite and tile data.
+    if (video->tileChangedStale) Vega_VideoResolveTileChanges();
+    if (video->tileCacheStale && video->renderThreadCount) Vega_VideoDecodeDirtyTiles();
+    if (video->spriteCacheStale) Vega_VideoEvaluateSprites();
+    if (video->spriteBucketsStale) Vega_VideoBuildSpriteBuckets();
+    for (plane = 0; plane < video->videoBackend.planeCount; plane++) {
+        if (video->planeCacheDirty[plane]) Vega_VideoRefreshPlaneCache(plane);
+    }
+    if (video->paletteCacheStale) Vega_VideoRefreshPaletteCache();
+    st->palette = video->paletteCurrent;
+    st->clearColor = video->clearColor;
+    st->reuse = false;
+    st->blank = video->videoBackend.shouldBlankLine && video->videoBackend.shouldBlankLine(line);
+    video->mainWork.calls[VEGA_VIDCB_BLANK] += video->videoBackend.shouldBlankLine != NULL;
+    if (st->blank) return;
+    st->visibleCount = 1;
+    st->visible[0] = (VegaVideoSpan){.start=0, .end=video->videoBackend.screenW};
+    if (video->videoBackend.getBlankSpans) Vega_VideoCaptureBlankSpans(st, line);
+    st->blank = !st->visibleCount;
+    if (st->blank) return;
+    for (plane = 0; plane < video->videoBackend.planeCount; plane++, pst++) {
+        pst->enabled = !(video->videoBackend.getPlaneEnabled && !video->videoBackend.getPlaneEnabled(plane));
+        video->mainWork.calls[VEGA_VIDCB_PLANESCROLL] += video->videoBackend.getPlaneEnabled != NULL;
+        pst->windowCount = 1;
+        pst->window[0] = (VegaVideoSpan){.start=0, .end=video->videoBackend.screenW};
+        if (pst->enabled && video->videoBackend.getPlaneWindow) {
+            pst->windowCount = Vega_VideoTrimSpans(pst->window, video->videoBackend.getPlaneWindow(plane, line, pst->window));
+            pst->enabled = pst->windowCount != 0;
+            video->mainWork.calls[VEGA_VIDCB_BLANK]++;
         }
+        if (!pst->enabled || video->videoBackend.getPlaneLine) continue;
+        video->mainWork.calls[VEGA_VIDCB_PLANESCROLL] += video->videoBackend.getPlaneHScrollTable ? 2 : 3;
+        if (video->videoBackend.getPlaneHScrollTable) pst->hscroll = video->hScrollTables[(plane * video->videoBackend.screenH) + line];
+        else pst->hscroll = video->videoBackend.getPlaneHScroll(plane, line);
+        pst->hmod = video->videoBackend.getPlaneHMod(plane);
+        pst->vmod = video->videoBackend.getPlaneVMod(plane);
     }
-    for (col = 0; col < videoBackend.screenW-1; col++) {
-        pixels[col+(line*videoBackend.screenW)] = videoBackend.getClearColor();
-        if (videoBackend.shouldBlankPixel && !videoBackend.shouldBlankPixel(line, col)) {    
-            for (prio = 0; prio < (1 << videoBackend.priorityIndexDepth)-1; prio++) {
-                if ((linebufget(col, prio) & 1)) {
-                    pixels[col+(line*videoBackend.screenW)] = linebufget(col, prio);
-                }
+}
+
+static u64 Vega_VideoHashVScroll(u8 plane) { // Without a scroll table, the only way to see a column scroll change is to ask for every column.
+    u64 hash = 0xCBF29CE484222325ull;
+    u32 col;
+    for (col = 0; col < VEGA_BACKEND_SCREENW(video); col++) {
+        hash = Vega_VideoMix(hash, VEGA_BACKEND_GETPLANEVSCROLL(video)(plane, (u16)col));
+    }
+    video->mainWork.calls[VEGA_VIDCB_PLANESCROLL] += VEGA_BACKEND_SCREENW(video);
+    return hash;
+}
+
+static void Vega_VideoCheckLine(u32 line) { // Marks a captured line for reuse if nothing it is drawn from changed since it was last drawn.
+    LineState * st = &video->lineJournal[line];
+    const PlaneLineState * pst = &video->planeJournal[line * video->videoBackend.planeCount];
+    const SpriteAttrib * spr;
+    u64 hash = Vega_VideoMix(Vega_VideoMix(Vega_VideoMix(0xCBF29CE484222325ull, video->paletteSerial), st->clearColor), st->blank);
+    u32 plane, i;
+    if (!st->blank) {
+        for (i = 0; i < st->visibleCount; i++) {
+            hash = Vega_VideoMix(hash, ((u32)st->visible[i].start << 16) | st->visible[i].end);
+        }
+        for (plane = 0; plane < video->videoBackend.planeCount; plane++, pst++) {
+            hash = Vega_VideoMix(hash, pst->enabled);
+            if (!pst->enabled) continue;
+            for (i = 0; i < pst->windowCount; i++) {
+                hash = Vega_VideoMix(hash, ((u32)pst->window[i].start << 16) | pst->window[i].end);
             }
+            if (video->videoBackend.getPlaneLine) continue;
+            hash = Vega_VideoMix(hash, ((u64)pst->hscroll << 32) | ((u64)pst->hmod << 16) | pst->vmod);
+            if (video->videoBackend.getPlaneVScrollTable) hash = Vega_VideoMix(hash, video->vScrollHashes[plane]);
+            else hash = Vega_VideoMix(hash, Vega_VideoHashVScroll(plane));
+        }
+        for (i = video->spriteBucketStart[line]; i < video->spriteBucketStart[line+1]; i++) {
+            spr = &video->spriteAttribs[video->spriteBuckets[i]];
+            hash = Vega_VideoMix(hash, ((u64)spr->id << 48) | ((u64)spr->x << 32) | ((u64)spr->w << 16) | (u16)(line - spr->y));
+            hash = Vega_VideoMix(hash, ((u64)spr->palette << 8) | spr->priority);
         }
     }
+    st->reuse = !video->lineForced[line] && hash == video->lineHashes[line];
+    video->lineHashes[line] = hash;
+    video->lineForced[line] = false;
 }
-#elif RENDER_GLFW
+
+#if RENDER_GLFW
 void Vega_ConstructLine(u32 line) {
     GLuint size = 0;
 
@@ -223,131 +1158,804 @@ void Vega_ConstructLine(u32 line) {
 }
 #endif
 
+static void Vega_VideoInvalidateCaches() { // Everything the renderer keeps about the backend has to be fetched again.
+    u32 i;
+    for (i = 0; i < video->videoBackend.memLocCount; i++) {
+        Vega_VideoMarkMemLoc(i, 0, video->memLocSizes[i]);
+    }
+    for (i = 0; i < video->videoBackend.planeCount; i++) {
+        video->planeCacheDirty[i] = true;
+    }
+    memset(video->tileCacheDirty, 0xFF, (video->videoBackend.tileCount + 7) >> 3);
+    video->tileCacheStale = true;
+    memset(video->paletteCacheDirty, true, 1 << video->videoBackend.paletteIndexDepth);
+    video->clearColorDirty = true;
+    video->paletteCacheStale = true;
+    video->spriteCacheStale = true;
+    memset(video->lineForced, true, video->videoBackend.screenH);
+}
+
+u32 Vega_VideoGetStateSize() {
+    u32 i, size = sizeof(StateHeader);
+    for (i = 0; i < video->videoBackend.memLocCount; i++) {
+        size += sizeof(u32) + (video->memLocOwned[i] ? video->memLocSizes[i] : 0);
+    }
+    size += video->videoBackend.saveStateCB ? video->videoBackend.stateSize : 0;
+    return (size + 7) & ~7u; // Padded to whole words for the rewind deltas.
+}
+
+void Vega_VideoSaveState(void * dst) {
+    u8 * out = dst;
+    u32 i, size, total = Vega_VideoGetStateSize();
+    StateHeader header = {.magic=VEGA_STATE_MAGIC, .size=total, .rasterFrame=video->rasterFrame, .memLocCount=video->videoBackend.memLocCount, .stateSize=video->videoBackend.saveStateCB ? video->videoBackend.stateSize : 0};
+    memcpy(out, &header, sizeof(StateHeader));
+    out += sizeof(StateHeader);
+    for (i = 0; i < video->videoBackend.memLocCount; i++) {
+        size = video->memLocOwned[i] ? video->memLocSizes[i] : 0;
+        memcpy(out, &size, sizeof(u32));
+        memcpy(out + sizeof(u32), video->memLocs[i], size);
+        out += sizeof(u32) + size;
+    }
+    if (video->videoBackend.saveStateCB) {
+        video->videoBackend.saveStateCB(out);
+        out += video->videoBackend.stateSize;
+    }
+    memset(out, 0, total - (out - (u8 *)dst));
+}
+
+bool8 Vega_VideoLoadState(const void * src, u32 size) {
+    const u8 * in = src;
+    u32 i, areaSize;
+    StateHeader header;
+    if (size < sizeof(StateHeader) || size != Vega_VideoGetStateSize()) return false;
+    memcpy(&header, in, sizeof(StateHeader));
+    if (header.magic != VEGA_STATE_MAGIC || header.size != size || header.memLocCount != video->videoBackend.memLocCount || header.stateSize != (video->videoBackend.saveStateCB ? video->videoBackend.stateSize : 0)) return false;
+    in += sizeof(StateHeader);
+    for (i = 0; i < video->videoBackend.memLocCount; i++) { // Checked before anything is touched.
+        memcpy(&areaSize, in, sizeof(u32));
+        if (areaSize != (video->memLocOwned[i] ? video->memLocSizes[i] : 0)) return false;
+        in += sizeof(u32) + areaSize;
+    }
+    in = (const u8 *)src + sizeof(StateHeader);
+    for (i = 0; i < video->videoBackend.memLocCount; i++) {
+        memcpy(&areaSize, in, sizeof(u32));
+        memcpy(video->memLocs[i], in + sizeof(u32), areaSize);
+        in += sizeof(u32) + areaSize;
+    }
+    if (video->videoBackend.saveStateCB && video->videoBackend.loadStateCB) video->videoBackend.loadStateCB(in);
+    video->rasterFrame = header.rasterFrame;
+    video->rasterNow = Vega_VideoRasterTime(0, 0);
+    Vega_VideoInvalidateCaches();
+    return true;
+}
+
+static inline u32 Vega_VideoPutVarint(u8 * dst, u32 val) {
+    u32 n = 0;
+    while (val >= 0x80) {
+        dst[n++] = (u8)(val | 0x80);
+        val >>= 7;
+    }
+    dst[n++] = (u8)val;
+    return n;
+}
+
+static inline u32 Vega_VideoGetVarint(const u8 * src, u32 * val) {
+    u32 n = 0, shift = 0;
+    *val = 0;
+    do {
+        *val |= (u32)(src[n] & 0x7F) << shift;
+        shift += 7;
+    } while (src[n++] & 0x80);
+    return n;
+}
+
+static u32 Vega_VideoEncodeDelta(const u64 * cur, const u64 * prev, u32 words, u8 * dst) { // Runs of unchanged words, then runs of XORed words.
+    u32 i = 0, start, n = 0;
+    u64 x;
+    while (i < words) {
+        for (start = i; i < words && cur[i] == prev[i]; i++);
+        n += Vega_VideoPutVarint(&dst[n], i - start);
+        for (start = i; i < words && cur[i] != prev[i]; i++);
+        n += Vega_VideoPutVarint(&dst[n], i - start);
+        for (; start < i; start++, n += 8) {
+            x = cur[start] ^ prev[start];
+            memcpy(&dst[n], &x, 8);
+        }
+    }
+    return n;
+}
+
+static void Vega_VideoApplyDelta(u64 * state, const u8 * src, u32 len) {
+    u32 pos = 0, word = 0, run;
+    u64 x;
+    while (pos < len) {
+        pos += Vega_VideoGetVarint(&src[pos], &run);
+        word += run;
+        pos += Vega_VideoGetVarint(&src[pos], &run);
+        for (; run; run--, word++, pos += 8) {
+            memcpy(&x, &src[pos], 8);
+            state[word] ^= x;
+        }
+    }
+}
+
+static void Vega_VideoFreeRewind() {
+    free(video->rewindLatest);
+    free(video->rewindNext);
+    free(video->rewindDelta);
+    free(video->rewindRing);
+    free(video->rewindOffsets);
+    free(video->rewindSizes);
+    video->rewindLatest = video->rewindNext = NULL;
+    video->rewindDelta = video->rewindRing = NULL;
+    video->rewindOffsets = video->rewindSizes = NULL;
+    video->rewindMaxFrames = video->rewindBytes = 0;
+    video->rewindFirst = video->rewindCount = video->rewindWrite = 0;
+    video->rewindPrimed = false;
+}
+
+void Vega_VideoSetRewind(u32 frames, u32 bytes) {
+    u32 words;
+    Vega_VideoFreeRewind();
+    if (!frames || !bytes) return;
+    video->rewindStateSize = Vega_VideoGetStateSize();
+    words = video->rewindStateSize / 8;
+    video->rewindLatest = malloc(video->rewindStateSize);
+    video->rewindNext = malloc(video->rewindStateSize);
+    video->rewindDelta = malloc((words * 8) + ((words + 1) * 10)); // Worst case, every other word changed.
+    video->rewindRing = malloc(bytes);
+    video->rewindOffsets = malloc(frames * sizeof(u32));
+    video->rewindSizes = malloc(frames * sizeof(u32));
+    if (!video->rewindLatest || !video->rewindNext || !video->rewindDelta || !video->rewindRing || !video->rewindOffsets || !video->rewindSizes) {
+        perror("video rewind allocation");
+        Vega_VideoFreeRewind();
+        return;
+    }
+    video->rewindMaxFrames = frames;
+    video->rewindBytes = bytes;
+}
+
+static bool8 Vega_VideoRewindOverlaps(u32 offset, u32 size) { // Returns true if any kept delta uses bytes OFFSET to OFFSET+SIZE of the ring.
+    u32 i, slot;
+    for (i = 0; i < video->rewindCount; i++) {
+        slot = (video->rewindFirst + i) % video->rewindMaxFrames;
+        if (video->rewindOffsets[slot] < offset + size && video->rewindOffsets[slot] + video->rewindSizes[slot] > offset) return true;
+    }
+    return false;
+}
+
+static void Vega_VideoCaptureRewind() {
+    u32 size, slot;
+    u64 * swap;
+    if (Vega_VideoGetStateSize() != video->rewindStateSize) { // A memory area was remapped, so the old history no longer lines up.
+        Vega_VideoSetRewind(video->rewindMaxFrames, video->rewindBytes);
+        if (!video->rewindMaxFrames) return;
+    }
+    Vega_VideoSaveState(video->rewindNext);
+    if (video->rewindPrimed) {
+        size = Vega_VideoEncodeDelta(video->rewindLatest, video->rewindNext, video->rewindStateSize / 8, video->rewindDelta);
+        if (size > video->rewindBytes) {
+            video->rewindCount = 0; // Too big to keep even alone, so the history restarts here.
+        } else {
+            if (video->rewindWrite + size > video->rewindBytes) video->rewindWrite = 0;
+            while (video->rewindCount && (video->rewindCount == video->rewindMaxFrames || Vega_VideoRewindOverlaps(video->rewindWrite, size))) { // Drop the oldest deltas until the new one fits.
+                video->rewindFirst++;
+                video->rewindCount--;
+            }
+            slot = (video->rewindFirst + video->rewindCount) % video->rewindMaxFrames;
+            memcpy(&video->rewindRing[video->rewindWrite], video->rewindDelta, size);
+            video->rewindOffsets[slot] = video->rewindWrite;
+            video->rewindSizes[slot] = size;
+            video->rewindWrite += size;
+            video->rewindCount++;
+        }
+    }
+    swap = video->rewindLatest;
+    video->rewindLatest = video->rewindNext;
+    video->rewindNext = swap;
+    video->rewindPrimed = true;
+}
+
+u32 Vega_VideoRewind(u32 frames) {
+    u32 n, slot;
+    if (!video->rewindPrimed) return 0;
+    for (n = 0; n < frames && video->rewindCount; n++) {
+        slot = (video->rewindFirst + video->rewindCount - 1) % video->rewindMaxFrames;
+        Vega_VideoApplyDelta(video->rewindLatest, &video->rewindRing[video->rewindOffsets[slot]], video->rewindSizes[slot]);
+        video->rewindWrite = video->rewindOffsets[slot]; // The newest delta is always the last one written, so its space is free again.
+        video->rewindCount--;
+    }
+    Vega_VideoLoadState(video->rewindLatest, video->rewindStateSize);
+    return n;
+}
+
+u32 Vega_VideoGetRewindFrames() {
+    return video->rewindCount;
+}
+
+static inline void Vega_VideoRunTo(u64 time) {
+    if (time <= video->rasterNow) return;
+    video->rasterNow = time;
+    if (video->videoBackend.runUntilCB) {
+        Vega_TraceBegin(VEGA_TRACE_RUNUNTIL, 0);
+        video->videoBackend.runUntilCB(time);
+        Vega_TraceEnd(VEGA_TRACE_RUNUNTIL);
+        video->mainWork.calls[VEGA_VIDCB_EVENT]++;
+    }
+}
+
+static void Vega_VideoSync(u64 time) { // Runs the backend up to TIME, stopping for each event due on the way.
+    VegaEvent event;
+    while (Vega_SchedPop(&video->scheduler, time, &event)) {
+        Vega_VideoRunTo(event.time);
+        Vega_TraceBegin(VEGA_TRACE_EVENT, 0);
+        event.cb(event.time, event.data);
+        Vega_TraceEnd(VEGA_TRACE_EVENT);
+        video->mainWork.calls[VEGA_VIDCB_EVENT]++;
+    }
+    Vega_VideoRunTo(time);
+}
+
+static void Vega_VideoRenderFrame(VegaVideoColor * pixels, u32 pitch) {
+    u32 line, plane;
+    VegaTime lineStart;
+    Vega_TraceBegin(VEGA_TRACE_RENDER, 0);
+    for (plane = 0; plane < video->videoBackend.planeCount; plane++) {
+        video->planeCacheDirty[plane] = true;
+    }
+    video->spriteCacheStale = true;
+    if (video->paletteCurrent != video->paletteCache) { // Every version from the last frame has been drawn, so the pool starts over.
+        memcpy(video->paletteCache, video->paletteCurrent, (1 << (video->videoBackend.paletteIndexDepth + video->videoBackend.colorIndexDepth)) * sizeof(VegaVideoColor));
+        video->paletteCurrent = video->paletteCache;
+    }
+    video->renderPixels = pixels;
+    video->renderPitch = pitch;
+    video->bandStart = video->bandEnd = 0;
+    video->linesDrawn = 0;
+    Vega_VideoSync(Vega_VideoRasterTime(0, 0));
+    Vega_IODrain(Vega_VideoRasterTime(0, 0));
+    if (video->videoBackend.frameStartCB) {
+        Vega_TraceBegin(VEGA_TRACE_FRAMESTART, 0);
+        video->videoBackend.frameStartCB();
+        Vega_TraceEnd(VEGA_TRACE_FRAMESTART);
+    }
+    for (line = 0; line < video->videoBackend.scanH; line++) {
+        if (line == video->videoBackend.screenH) Vega_VideoFlushLines(); // VBlank callbacks are free to change anything.
+        if (line <= video->videoBackend.screenH || video->videoBackend.lineStartCB) Vega_VideoSync(Vega_VideoRasterTime(line, 0)); // Lines nothing looks at are left to run together.
+        Vega_IODrain(Vega_VideoRasterTime(line, 0));
+        if (video->videoBackend.lineStartCB) {
+            Vega_TraceBegin(VEGA_TRACE_LINESTART, line);
+            video->videoBackend.lineStartCB(line);
+            Vega_TraceEnd(VEGA_TRACE_LINESTART);
+        }
+        if (line == video->videoBackend.screenH && video->videoBackend.vBlankCB) {
+            Vega_TraceBegin(VEGA_TRACE_VBLANK, 0);
+            video->videoBackend.vBlankCB();
+            Vega_TraceEnd(VEGA_TRACE_VBLANK);
+        } else if (line < video->videoBackend.screenH) {
+            Vega_VideoCaptureLine(line);
+            if (video->incremental) Vega_VideoCheckLine(line);
+            video->linesDrawn += !video->lineJournal[line].reuse;
+            if (video->renderThreadCount) { // Reused lines are skipped by the workers.
+                video->bandEnd = line + 1;
+                video->journalPending = true;
+                if (video->bandEnd - video->bandStart >= video->renderBandLines) Vega_VideoDispatchLines(video->bandEnd);
+            } else if (!video->lineJournal[line].reuse) {
+                lineStart = Vega_VideoGetAbsTime();
+                Vega_TraceBegin(VEGA_TRACE_LINE, line);
+                Vega_RenderLine(&video->mainWork, line, pixels, pitch);
+                Vega_TraceEnd(VEGA_TRACE_LINE);
+                Vega_VideoTimeLine(&video->mainWork, Vega_VideoGetAbsTime() - lineStart);
+            }
+            if (video->videoBackend.scanW > video->videoBackend.screenW) {
+                if (video->videoBackend.hBlankCB) Vega_VideoSync(Vega_VideoRasterTime(line, video->videoBackend.screenW));
+                Vega_IODrain(Vega_VideoRasterTime(line, video->videoBackend.screenW));
+                if (video->videoBackend.hBlankCB) {
+                    Vega_TraceBegin(VEGA_TRACE_HBLANK, line);
+                    video->videoBackend.hBlankCB(line);
+                    Vega_TraceEnd(VEGA_TRACE_HBLANK);
+                }
+            }
+        }
+        if (video->videoBackend.lineEndCB) {
+            Vega_VideoSync(Vega_VideoRasterTime(line, video->videoBackend.scanW));
+            Vega_TraceBegin(VEGA_TRACE_LINEEND, line);
+            video->videoBackend.lineEndCB(line);
+            Vega_TraceEnd(VEGA_TRACE_LINEEND);
+        }
+    }
+    Vega_VideoSync(Vega_VideoRasterTime(video->videoBackend.scanH, 0));
+    Vega_VideoFlushLines();
+    if (video->videoBackend.frameEndCB) {
+        Vega_TraceBegin(VEGA_TRACE_FRAMEEND, 0);
+        video->videoBackend.frameEndCB();
+        Vega_TraceEnd(VEGA_TRACE_FRAMEEND);
+    }
+    video->rasterFrame++;
+    if (video->rewindMaxFrames) Vega_VideoCaptureRewind();
+    video->mainWork.calls[VEGA_VIDCB_EVENT] += (video->videoBackend.frameStartCB != NULL) + (video->videoBackend.frameEndCB != NULL)
+        + (video->videoBackend.scanH * ((video->videoBackend.lineStartCB != NULL) + (video->videoBackend.lineEndCB != NULL)))
+        + (video->videoBackend.vBlankCB && video->videoBackend.scanH > video->videoBackend.screenH)
+        + ((video->videoBackend.hBlankCB && video->videoBackend.scanW > video->videoBackend.screenW) ? video->videoBackend.screenH : 0);
+    Vega_TraceEnd(VEGA_TRACE_RENDER);
+}
+
+static void Vega_VideoCollectStats(LineWork * work) {
+    u32 i;
+    for (i = 0; i < VEGA_VIDCB_COUNT; i++) {
+        video->videoStats.callbacks[i] += work->calls[i];
+    }
+    for (i = 0; i < VEGA_VIDSTATS_LINEBUCKETS; i++) {
+        video->videoStats.lineTimes[i] += work->lineTimes[i];
+    }
+    if (work->lineTimeMax > video->videoStats.lineTimeMax) video->videoStats.lineTimeMax = work->lineTimeMax;
+    memset(work->calls, 0, sizeof(work->calls));
+    memset(work->lineTimes, 0, sizeof(work->lineTimes));
+    work->lineTimeMax = 0;
+}
+
+static void Vega_VideoFinishStats(VegaTime frameStart, VegaTime renderStart, VegaTime renderEnd, VegaTime presentEnd, bool8 late) { // The render threads are idle between frames, so their counters can be read without locking.
+    u32 i;
+    VegaTime frameEnd = Vega_VideoGetAbsTime();
+    memset(video->videoStats.lineTimes, 0, sizeof(video->videoStats.lineTimes));
+    memset(video->videoStats.callbacks, 0, sizeof(video->videoStats.callbacks));
+    video->videoStats.lineTimeMax = 0;
+    Vega_VideoCollectStats(&video->mainWork);
+    for (i = 0; i < video->renderThreadCount; i++) {
+        Vega_VideoCollectStats(&video->renderWork[i]);
+    }
+    video->videoStats.frames++;
+    video->videoStats.lateFrames += late;
+    video->videoStats.frameTime = frameEnd - frameStart;
+    if (video->videoStats.frameTime > video->videoStats.frameTimeMax) video->videoStats.frameTimeMax = video->videoStats.frameTime;
+    video->videoStats.renderTime = renderEnd - renderStart;
+    video->videoStats.presentTime = presentEnd - renderEnd;
+    video->videoStats.sleepTime = frameEnd - presentEnd;
+    video->videoStats.linesDrawn = video->linesDrawn;
+}
+
+static void Vega_VideoPresentFrame(const VegaVideoColor * pixels, u32 pitch) {
+    Vega_TraceBegin(VEGA_TRACE_OUTPUT, 0);
+    if (video->frameCB) video->frameCB(pixels, video->videoBackend.screenW, video->videoBackend.screenH, pitch);
+    if (video->sink && !Vega_SinkPush(video->sink, pixels, pitch, video->videoStats.frames)) video->videoStats.droppedFrames++;
+    Vega_TraceEnd(VEGA_TRACE_OUTPUT);
+}
+
 void Vega_VideoRun() {
-    bool8 running = true;
+    Vega_VideoRunFrames(0);
+}
+
+void Vega_VideoRunFrames(u32 frames) {
     VegaVideoColor * pixels;
-    u32 pitch, line, col, i;
+    u32 pitch, frame, row;
     int w, h;
+    VegaTime frameStart, renderStart, renderEnd, presentEnd;
+    bool8 late;
 
-    VegaTime fstarttick, lstarttick, fendtick, lendtick;
-    linebufs = malloc(videoBackend.screenW * (1 << videoBackend.priorityIndexDepth) * 2);
-    while (running) {
-        fstarttick = Vega_VideoGetTime();
+    video->running = true;
+    video->frameDeadline = Vega_VideoGetAbsTime();
+    Vega_TraceNameThread("video", -1);
+    for (frame = 0; video->running && (!frames || frame < frames); frame++) {
+        Vega_TraceBegin(VEGA_TRACE_FRAME, (u32)video->videoStats.frames);
+        frameStart = renderStart = renderEnd = Vega_VideoGetAbsTime();
+        if (video->videoMode == VEGA_VIDMODE_HEADLESS) {
+            pitch = video->videoBackend.screenW * sizeof(VegaVideoColor);
+            Vega_VideoRenderFrame(video->frameBuf, pitch);
+            renderEnd = Vega_VideoGetAbsTime();
+            Vega_VideoPresentFrame(video->frameBuf, pitch);
+            presentEnd = Vega_VideoGetAbsTime();
+            late = Vega_VideoWaitFrame();
+            Vega_VideoFinishStats(frameStart, renderStart, renderEnd, presentEnd, late);
+            Vega_TraceEnd(VEGA_TRACE_FRAME);
+            continue;
+        }
 #if RENDER_SDL
-        SDL_QueryTexture(fBuf, NULL, NULL, &w, &h);
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             switch (event.type) {
                 case SDL_QUIT:
-                    running = false;
+                    video->running = false;
                     break;
             }
         }
-        SDL_LockTexture(fBuf, NULL, (void **)&pixels, (int *)&pitch);
-#elif RENDER_GLFW
-        glfwPollEvents();
-        running = glfwWindowShouldClose(win) ? true : false;
-#endif
-#if RENDER_SDL
-        if (videoBackend.frameStartCB) videoBackend.frameStartCB();
-        for (line = 0; line < videoBackend.scanH; line++) {
-            lstarttick = Vega_VideoGetTime();
-            if (videoBackend.lineStartCB) videoBackend.lineStartCB(line);
-            if (line == videoBackend.screenH && videoBackend.vBlankCB) videoBackend.vBlankCB();
-            else if (line < videoBackend.screenH-1) {
-                Vega_RenderLine(line, pixels, pitch);
+        if (video->presentThreaded) {
+            pixels = &video->presentBufs[video->presentDrawn * video->videoBackend.screenW * video->videoBackend.screenH];
+            pitch = video->videoBackend.screenW * sizeof(VegaVideoColor);
+            renderStart = Vega_VideoGetAbsTime();
+            if (video->incremental) { // The kept lines are two frames old in the ring, so they are drawn in frameBuf.
+                Vega_VideoRenderFrame(video->frameBuf, pitch);
+                memcpy(pixels, video->frameBuf, video->videoBackend.screenH * pitch);
+            } else {
+                Vega_VideoRenderFrame(pixels, pitch);
+            }
+            renderEnd = Vega_VideoGetAbsTime();
+            Vega_VideoPresentFrame(pixels, pitch);
+            Vega_TraceBegin(VEGA_TRACE_PRESENT, 0);
+            Vega_VideoHandOffFrame();
+            Vega_TraceEnd(VEGA_TRACE_PRESENT);
+            presentEnd = Vega_VideoGetAbsTime();
+            late = Vega_VideoWaitFrame();
+            Vega_VideoFinishStats(frameStart, renderStart, renderEnd, presentEnd, late);
+            Vega_TraceEnd(VEGA_TRACE_FRAME);
+            continue;
+        }
+        SDL_QueryTexture(video->fBuf, NULL, NULL, &w, &h);
+        SDL_LockTexture(video->fBuf, NULL, (void **)&pixels, (int *)&pitch);
+        renderStart = Vega_VideoGetAbsTime();
+        if (video->incremental) { // A locked texture's old contents are lost, so the kept lines live in frameBuf.
+            Vega_VideoRenderFrame(video->frameBuf, video->videoBackend.screenW * sizeof(VegaVideoColor));
+            for (row = 0; row < video->videoBackend.screenH; row++) {
+                memcpy((u8 *)pixels + (row * pitch), &video->frameBuf[row * video->videoBackend.screenW], video->videoBackend.screenW * sizeof(VegaVideoColor));
             }
-            if (videoBackend.lineEndCB) videoBackend.lineEndCB(line);
-            lendtick = Vega_VideoGetTime();
-            Vega_VideoSleep(((1.0l/60.0l)/(VegaTime)(videoBackend.scanH)) - (lendtick - lstarttick));
+        } else {
+            Vega_VideoRenderFrame(pixels, pitch);
         }
-        if (videoBackend.frameEndCB) videoBackend.frameEndCB();
+        renderEnd = Vega_VideoGetAbsTime();
+        Vega_VideoPresentFrame(pixels, pitch);
+        Vega_TraceBegin(VEGA_TRACE_PRESENT, 0);
+        SDL_UnlockTexture(video->fBuf);
+        SDL_RenderCopy(video->rend, video->fBuf, NULL, NULL);
+        SDL_RenderPresent(video->rend);
+        Vega_TraceEnd(VEGA_TRACE_PRESENT);
 #elif RENDER_GLFW
+        u32 line;
+        glfwPollEvents();
+        video->running = glfwWindowShouldClose(video->win) ? true : false;
         glClearColor(
-            (float)(videoBackend.getClearColor() >> 11) / (float)((1 << 5)-1),
-            (float)(videoBackend.getClearColor() >> 6) / (float)((1 << 5)-1), 
-            (float)(videoBackend.getClearColor() >> 1) / (float)((1 << 5)-1), 
+            (float)(video->videoBackend.getClearColor() >> 11) / (float)((1 << 5)-1),
+            (float)(video->videoBackend.getClearColor() >> 6) / (float)((1 << 5)-1), 
+            (float)(video->videoBackend.getClearColor() >> 1) / (float)((1 << 5)-1), 
             1.0
         );
         glClear(GL_COLOR_BUFFER_BIT);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-        if (videoBackend.frameStartCB) videoBackend.frameStartCB();
-        for (line = 0; line < videoBackend.scanH; line++) {
-            lstarttick = Vega_VideoGetTime();
-            if (videoBackend.lineStartCB) videoBackend.lineStartCB(line);
-            if (line == videoBackend.screenH && videoBackend.vBlankCB) videoBackend.vBlankCB();
-            else if (line < videoBackend.screenH) {
+        glBindBuffer(GL_ARRAY_BUFFER, video->VBO);
+
+        if (video->videoBackend.frameStartCB) video->videoBackend.frameStartCB();
+        for (line = 0; line < video->videoBackend.scanH; line++) {
+            if (video->videoBackend.lineStartCB) video->videoBackend.lineStartCB(line);
+            if (line == video->videoBackend.screenH && video->videoBackend.vBlankCB) video->videoBackend.vBlankCB();
+            else if (line < video->videoBackend.screenH) {
                 Vega_ConstructLine(line);
             }
-            if (videoBackend.lineEndCB) videoBackend.lineEndCB(line);
-            lendtick = Vega_VideoGetTime();
-            Vega_VideoSleep((lendtick - lstarttick) - (1.0l/(VegaTime)(videoBackend.scanH))/60.0l);
+            if (video->videoBackend.lineEndCB) video->videoBackend.lineEndCB(line);
         }
-        if (videoBackend.frameEndCB) videoBackend.frameEndCB();
+        if (video->videoBackend.frameEndCB) video->videoBackend.frameEndCB();
 
-#endif
-#if RENDER_SDL
-        SDL_UnlockTexture(fBuf);
-        SDL_RenderCopy(rend, fBuf, NULL, NULL);
-        SDL_RenderPresent(rend);
-#elif RENDER_GLFW
-        glfwSwapBuffers(win);
+        glfwSwapBuffers(video->win);
 #endif  
-        fendtick = Vega_VideoGetTime();
-        // printf("\r%Lf             ", 1.0l/(fendtick-fstarttick));
-        Vega_VideoSleep((fendtick - fstarttick) - 1.0l/60.0l);
+        presentEnd = Vega_VideoGetAbsTime();
+        late = Vega_VideoWaitFrame();
+        Vega_VideoFinishStats(frameStart, renderStart, renderEnd, presentEnd, late);
+        Vega_TraceEnd(VEGA_TRACE_FRAME);
     }
-    free(linebufs);
+}
+
+void Vega_VideoStop() {
+    video->running = false;
 }
 
 void Vega_VideoDeinit() {
-    if (videoBackend.deinitCB) videoBackend.deinitCB();
+    Vega_VideoStopRenderThreads();
+    Vega_VideoCloseSink();
+    if (Vega_VideoUsesPresentThread()) Vega_VideoStopPresentThread();
+    if (video->videoBackend.deinitCB) video->videoBackend.deinitCB();
+    if (video->videoMode != VEGA_VIDMODE_HEADLESS) {
 #if RENDER_SDL
-    SDL_DestroyWindow(win);
-    SDL_DestroyRenderer(rend);
-    SDL_DestroyTexture(fBuf);
+        SDL_DestroyWindow(video->win);
+        SDL_DestroyRenderer(video->rend);
+        SDL_DestroyTexture(video->fBuf);
 #elif RENDER_GLFW
-    glfwDestroyWindow(win);
+        glfwDestroyWindow(video->win);
 #endif
-    for (int i = 0; i < videoBackend.memLocCount; i++) {
-        free(memLocs[i]);
     }
-    free(memLocs);
+    for (int i = 0; i < video->videoBackend.memLocCount; i++) {
+        if (!video->memLocOwned[i]) free(video->memLocDirty[i]);
+    }
+    if (video->paletteCache != video->paletteCacheHome) free(video->paletteCache);
+    free(video->spriteBuckets);
+    video->spriteBuckets = NULL;
+    video->spriteBucketCap = 0;
+    Vega_VideoFreeRewind();
+    Vega_SchedFree(&video->scheduler);
+    Vega_VideoFreeArena();
+    Vega_VideoLayoutArena(); // Clears every pointer into the arena.
+}
+
+void Vega_VideoSetRefreshRate(double hz) {
+    video->frameInterval = (hz > 0.0) ? (VegaTime)(1000000000.0 / hz) : 0;
+    video->frameDeadline = Vega_VideoGetAbsTime();
+}
+
+bool8 Vega_VideoSetRenderThreads(u8 threads, u16 bandLines) {
+    u32 i, size = 1 << (video->videoBackend.paletteIndexDepth + video->videoBackend.colorIndexDepth);
+    VegaVideoColor * pool;
+    void * buffers;
+    Vega_VideoStopRenderThreads();
+    video->renderBandLines = bandLines ? bandLines : 16;
+    pool = threads ? malloc(size * (video->videoBackend.screenH + 1) * sizeof(VegaVideoColor)) : video->paletteCacheHome;
+    if (!pool) {
+        perror("video palette cache allocation");
+        return false;
+    }
+    memmove(pool, video->paletteCurrent, size * sizeof(VegaVideoColor));
+    if (video->paletteCache != video->paletteCacheHome) free(video->paletteCache);
+    video->paletteCache = video->paletteCurrent = pool;
+    if (!threads) return true;
+    video->renderWork = malloc(threads * sizeof(LineWork));
+    video->renderThreads = malloc(threads * sizeof(pthread_t));
+    video->bandQueue = malloc(video->videoBackend.screenH * sizeof(LineBand));
+    video->renderBuffers = posix_memalign(&buffers, VEGA_ARENA_LINE, threads * Vega_VideoLineWorkSize()) ? NULL : buffers;
+    if (!video->renderWork || !video->renderThreads || !video->bandQueue || !video->renderBuffers) {
+        perror("video render thread allocation");
+        Vega_VideoStopRenderThreads();
+        return false;
+    }
+    video->renderQuit = false;
+    video->bandQueued = video->bandTaken = video->bandDone = 0;
+    for (i = 0; i < threads; i++) {
+        Vega_VideoCarveLineWork(&video->renderWork[i], video->renderBuffers + (i * Vega_VideoLineWorkSize()));
+        video->renderWork[i].state = video;
+        if (pthread_create(&video->renderThreads[i], NULL, Vega_VideoRenderWorker, &video->renderWork[i])) {
+            perror("video render thread creation");
+            break;
+        }
+    }
+    video->renderThreadCount = i;
+    if (i == threads) return true;
+    Vega_VideoStopRenderThreads(); // Lines go back to the calling thread rather than fewer threads than asked for.
+    return false;
+}
+
+VegaVideoState * Vega_VideoCreateState(VegaContext * owner) {
+    VegaVideoState * state = malloc(sizeof(VegaVideoState));
+    if (!state) {
+        perror("video state allocation");
+        return NULL;
+    }
+    *state = (VegaVideoState)VEGA_VIDEO_STATE_INIT;
+    state->owner = owner;
+    return state;
+}
+
+void Vega_VideoDestroyState(VegaVideoState * state) { // The state must be deinitialized and bound to no other thread.
+    if (!state || state == &videoDefault) return;
+    if (video == state) video = &videoDefault;
+    free(state->arenaPath);
+    pthread_mutex_destroy(&state->renderLock);
+    pthread_cond_destroy(&state->renderWake);
+    pthread_cond_destroy(&state->renderDone);
+    pthread_mutex_destroy(&state->presentLock);
+    pthread_cond_destroy(&state->presentWake);
+    free(state);
+}
+
+void Vega_VideoBindState(VegaVideoState * state) {
+    video = state ? state : &videoDefault;
+}
+
+VegaVideoEventID Vega_VideoScheduleEvent(u64 time, VegaVideoEventCB cb, void * data) {
+    return Vega_SchedAdd(&video->scheduler, time, cb, data);
+}
+
+bool8 Vega_VideoCancelEvent(VegaVideoEventID id) {
+    return Vega_SchedCancel(&video->scheduler, id);
+}
+
+u64 Vega_VideoGetNextEventTime() {
+    return Vega_SchedNext(&video->scheduler);
+}
+
+u64 Vega_VideoGetRasterTime(u32 * line, u32 * col) {
+    u64 frameTime = video->rasterNow % ((u64)video->videoBackend.scanH * video->videoBackend.scanW);
+    if (line) *line = (u32)(frameTime / video->videoBackend.scanW);
+    if (col) *col = (u32)(frameTime % video->videoBackend.scanW);
+    return video->rasterNow;
+}
+
+void Vega_VideoGetStats(VegaVideoStats * stats) {
+    *stats = video->videoStats;
+}
+
+const VegaVideoColor * Vega_VideoGetFrame() {
+    return (video->videoMode == VEGA_VIDMODE_HEADLESS) ? video->frameBuf : NULL;
+}
+
+void Vega_VideoSetIncremental(bool8 enabled) {
+    video->incremental = enabled;
+    memset(video->lineForced, true, video->videoBackend.screenH);
+    memset(video->tileChanged, 0, (video->videoBackend.tileCount + 7) >> 3);
+    video->tileChangedStale = false;
+}
+
+void Vega_VideoSetPresentThread(bool8 enabled) {
+    video->presentThreaded = enabled;
+}
+
+void Vega_VideoSetFrameCB(VegaVideoFrameCB cb) {
+    video->frameCB = cb;
+}
+
+bool8 Vega_VideoOpenSinkFD(int fd, u32 slots) {
+    Vega_VideoCloseSink();
+    video->sink = Vega_SinkOpenFD(fd, slots, video->sinkOutput, video->videoBackend.screenW, video->videoBackend.screenH);
+    return video->sink != NULL;
+}
+
+bool8 Vega_VideoOpenSinkShm(const char * name, u32 slots) {
+    Vega_VideoCloseSink();
+    video->sink = Vega_SinkOpenShm(name, slots, video->sinkOutput, video->videoBackend.screenW, video->videoBackend.screenH);
+    return video->sink != NULL;
+}
+
+void Vega_VideoSetSinkOutput(VegaVideoOutput output) {
+    if (!output.scale) output.scale = 1;
+    if (output.scale > VEGA_VIDOUT_MAXSCALE) output.scale = VEGA_VIDOUT_MAXSCALE;
+    video->sinkOutput = output;
+}
+
+void Vega_VideoCloseSink() {
+    Vega_SinkClose(video->sink);
+    video->sink = NULL;
 }
 
 void Vega_VideoSetTitle(const char * name) {
+    if (video->videoMode == VEGA_VIDMODE_HEADLESS) return;
 #if RENDER_SDL
-    SDL_SetWindowTitle(win, name);
+    SDL_SetWindowTitle(video->win, name);
 #elif RENDER_GLFW
-    glfwSetWindowTitle(win, name);
+    glfwSetWindowTitle(video->win, name);
 #endif
 }
 
 void * Vega_VideoGetMemLoc(u8 index) {
-    return memLocs[index];
+    return video->memLocs[index];
+}
+
+u32 Vega_VideoGetMemLocSize(u8 index) {
+    return (index < video->videoBackend.memLocCount) ? video->memLocSizes[index] : 0;
+}
+
+void Vega_VideoMapMemLoc(u8 index, void * buffer, u32 size) {
+    if (index >= video->videoBackend.memLocCount) return;
+    Vega_VideoAttachMemLoc(index, buffer, size);
+    if (!buffer) memset(video->memLocs[index], 0, video->memLocSizes[index]);
+}
+
+void Vega_VideoSetArena(VegaVideoArenaType type, const char * path) {
+    video->arenaType = type;
+    free(video->arenaPath);
+    video->arenaPath = path ? strdup(path) : NULL;
+    if (path && !video->arenaPath) perror("video arena path allocation");
+}
+
+void * Vega_VideoGetArena(u64 * size) {
+    if (size) *size = video->arenaSize;
+    return video->arena;
+}
+
+u64 Vega_VideoGetMemLocOffset(u8 index) {
+    if (index >= video->videoBackend.memLocCount || !video->memLocOwned[index]) return UINT64_MAX;
+    return (u8 *)video->memLocs[index] - video->arena;
+}
+
+void Vega_VideoMarkMemLoc(u8 index, u32 offset, u32 len) {
+    u32 block, last;
+    u64 * bits;
+    if (!video->videoBackend.memDirtyCB || index >= video->videoBackend.memLocCount || !len || offset >= video->memLocSizes[index]) return;
+    if (len > video->memLocSizes[index] - offset) len = video->memLocSizes[index] - offset;
+    bits = video->memLocDirty[index];
+    last = (offset + len - 1) / VEGA_VIDMEM_DIRTYBLOCK;
+    for (block = offset / VEGA_VIDMEM_DIRTYBLOCK; block <= last;) {
+        if (!(block & 63) && last - block >= 63) { // Whole words at a time for large transfers.
+            bits[block >> 6] = UINT64_MAX;
+            block += 64;
+        } else {
+            bits[block >> 6] |= (u64)1 << (block & 63);
+            block++;
+        }
+    }
+    video->memLocStale = true;
+}
+
+static u32 Vega_VideoClipMemLoc(u8 index, u32 offset, u32 len) { // Returns how many of LEN bytes at OFFSET fit in memory area INDEX.
+    if (index >= video->videoBackend.memLocCount || offset >= video->memLocSizes[index]) return 0;
+    return (len > video->memLocSizes[index] - offset) ? video->memLocSizes[index] - offset : len;
+}
+
+void Vega_VideoDMACopy(u8 index, u32 offset, const void * src, u32 len) {
+    len = Vega_VideoClipMemLoc(index, offset, len);
+    if (!len) return;
+    memcpy((u8 *)video->memLocs[index] + offset, src, len);
+    Vega_VideoMarkMemLoc(index, offset, len);
+}
+
+void Vega_VideoDMAFill(u8 index, u32 offset, u8 value, u32 len) {
+    len = Vega_VideoClipMemLoc(index, offset, len);
+    if (!len) return;
+    memset((u8 *)video->memLocs[index] + offset, value, len);
+    Vega_VideoMarkMemLoc(index, offset, len);
+}
+
+void Vega_VideoDMAFill16(u8 index, u32 offset, u16 value, u32 count) {
+    u32 i, len = Vega_VideoClipMemLoc(index, offset, count * 2) & ~1u;
+    u8 * dst;
+    if (!len) return;
+    dst = (u8 *)video->memLocs[index] + offset;
+    if ((u8)value == (u8)(value >> 8)) {
+        memset(dst, (u8)value, len);
+    } else {
+        for (i = 0; i < len; i += 2) { // Vectorized by the compiler, the memcpy keeps unaligned offsets legal.
+            memcpy(dst + i, &value, 2);
+        }
+    }
+    Vega_VideoMarkMemLoc(index, offset, len);
 }
 
 void Vega_VideoUpdatePaletteCache(u8 line) {
+    if (line < (1 << video->videoBackend.paletteIndexDepth)) {
+        video->paletteCacheDirty[line] = true;
+        video->paletteCacheStale = true;
+    }
 #if RENDER_GLFW
-    glBindTexture(GL_TEXTURE_2D, paletteTexture);
-    u16 tmp[1 << videoBackend.colorIndexDepth];
-    for (u8 i = 0; i < (1 << videoBackend.colorIndexDepth); i++) {
-        tmp[i] = videoBackend.getPaletteColor(line, i);
+    glBindTexture(GL_TEXTURE_2D, video->paletteTexture);
+    u16 tmp[1 << video->videoBackend.colorIndexDepth];
+    for (u8 i = 0; i < (1 << video->videoBackend.colorIndexDepth); i++) {
+        tmp[i] = video->videoBackend.getPaletteColor(line, i);
     }
-    glTexSubImage2D(paletteTexture, 0, 0, line, (1 << videoBackend.colorIndexDepth), 1, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, tmp);
+    glTexSubImage2D(video->paletteTexture, 0, 0, line, (1 << video->videoBackend.colorIndexDepth), 1, GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, tmp);
 #endif
 }
 
+void Vega_VideoUpdateSpriteCache(u16 sprite) {
+    if (sprite >= video->videoBackend.spriteCount) return;
+    if (video->journalPending) Vega_VideoFlushLines();
+    if (video->spriteSlots[sprite] == UINT16_MAX) {
+        video->spriteCacheStale = true; // The sprite may have just been enabled, so the chain has to be walked again.
+    } else {
+        video->spriteAttribDirty[video->spriteSlots[sprite]] = true;
+        video->spriteBucketsStale = true;
+        Vega_VideoInvalidateLines(video->spriteAttribs[video->spriteSlots[sprite]].y, video->spriteAttribs[video->spriteSlots[sprite]].h); // Its pixels may have changed where it was.
+    }
+}
+
+void Vega_VideoUpdateClearColor() {
+    video->clearColorDirty = true;
+    video->paletteCacheStale = true;
+}
+
 void Vega_VideoUpdateTileCache(u16 tile) {
+    if (video->journalPending) Vega_VideoFlushLines(); // The workers may still be reading the tile through the backend.
+    if (tile < video->videoBackend.tileCount) {
+        video->tileCacheDirty[tile >> 3] |= 1 << (tile & 7);
+        video->tileCacheStale = true;
+        if (video->incremental) {
+            video->tileChanged[tile >> 3] |= 1 << (tile & 7);
+            video->tileChangedStale = true;
+        }
+    } else if (video->incremental) { // Uncached tiles aren't tracked per line.
+        Vega_VideoInvalidateLines(0, video->videoBackend.screenH);
+    }
 #if RENDER_GLFW
-    glBindTexture(GL_TEXTURE_2D, tileTexture);
+    glBindTexture(GL_TEXTURE_2D, video->tileTexture);
     u8 tmp[8][8];
     for (u8 y = 0; y < 8; y++) {
         for (u8 x = 0; x < 8; x++) {
-            tmp[y][x] = videoBackend.getTileColor(tile, x, y);
+            tmp[y][x] = video->videoBackend.getTileColor(tile, x, y);
         }
     }
-    glTexSubImage2D(tileTexture, 0, 0, tile*8, 8, 8, GL_R, GL_UNSIGNED_BYTE, tmp);
+    glTexSubImage2D(video->tileTexture, 0, 0, tile*8, 8, 8, GL_R, GL_UNSIGNED_BYTE, tmp);
 #endif
+}
+
+void Vega_VideoUpdatePlaneCache(u8 plane) {
+    if (plane >= video->videoBackend.planeCount) return;
+    if (video->journalPending) Vega_VideoFlushLines();
+    video->planeCacheDirty[plane] = true;
+    Vega_VideoInvalidateLines(0, video->videoBackend.screenH);
+}
+
+void Vega_VideoInvalidateLines(u32 first, u32 count) {
+    if (first >= video->videoBackend.screenH) return;
+    if (count > video->videoBackend.screenH - first) count = video->videoBackend.screenH - first;
+    memset(&video->lineForced[first], true, count);
 }
\ No newline at end of file